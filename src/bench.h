@@ -0,0 +1,12 @@
+#pragma once
+
+constexpr int BENCH_DEPTH = 13;
+
+void movebench_main(int depth);
+void pickbench_main(int repeats);
+
+/**
+ * Search the bench positions. The search is single-threaded, so `threads`
+ * must be 1. Returns the process exit code.
+ */
+int bench_main(int depth, int threads, int hashMB);
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <functional>
+#ifdef CHESS_PEXT_DISPATCH
+#include <cpuid.h>
+#endif
 
 #include "attacks_fwd.hpp"
 #include "bitboard.hpp"
@@ -136,7 +139,9 @@ inline void attacks::initSliders(
     table_sq.magic = magic;
 #endif
     table_sq.mask = (attacks(sq, occ) & ~edges).getBits();
-#ifndef CHESS_USE_PEXT
+#ifdef CHESS_PEXT_DISPATCH
+    table_sq.shift = usePext ? 0 : 64 - Bitboard(table_sq.mask).count();
+#elif !defined(CHESS_USE_PEXT)
     table_sq.shift = 64 - Bitboard(table_sq.mask).count();
 #endif
 
@@ -151,7 +156,31 @@ inline void attacks::initSliders(
     } while (occ);
 }
 
+#ifdef CHESS_PEXT_DISPATCH
+inline bool attacks::hasFastPext() noexcept {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_BMI2)) return false;
+
+    // Vendor strings in the register order EBX, EDX, ECX. Hygon CPUs are
+    // based on Zen 1.
+    __get_cpuid(0, &eax, &ebx, &ecx, &edx);
+    const bool amd   = ebx == 0x68747541 && edx == 0x69746e65 && ecx == 0x444d4163;
+    const bool hygon = ebx == 0x6f677948 && edx == 0x6e65476e && ecx == 0x656e6975;
+    if (hygon) return false;
+    if (!amd) return true;
+
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    unsigned family = (eax >> 8) & 0xf;
+    if (family == 0xf) family += (eax >> 20) & 0xff;
+    return family >= 0x19;
+}
+#endif
+
 inline void attacks::initAttacks() {
+#ifdef CHESS_PEXT_DISPATCH
+    usePext = hasFastPext();
+#endif
+
     BishopTable[0].attacks = BishopAttacks;
     RookTable[0].attacks   = RookAttacks;
 
@@ -2,7 +2,7 @@
 
 #include <cstdint>
 #include <functional>
-#ifdef CHESS_USE_PEXT
+#if defined(CHESS_USE_PEXT) || defined(CHESS_PEXT_DISPATCH)
 #include <immintrin.h>
 #endif
 
@@ -22,6 +22,26 @@ class attacks {
         Bitboard* attacks;
         U64       operator()(Bitboard b) const noexcept { return _pext_u64(b.getBits(), mask); }
     };
+#elif defined(CHESS_PEXT_DISPATCH)
+    // Both indexings, selected at startup by initAttacks(). The tables are
+    // filled for the selected one only, and a shift of 0 marks PEXT indexing,
+    // so a lookup tests the entry it loads anyway instead of a global flag.
+    static inline bool usePext = false;
+
+    struct Magic {
+        U64       mask;
+        U64       magic;
+        Bitboard* attacks;
+        U64       shift;
+        U64       operator()(Bitboard b) const noexcept {
+            if (shift != 0) return (((b & mask)).getBits() * magic) >> shift;
+            return _pext_u64(b.getBits(), mask);
+        }
+    };
+
+    // Whether PEXT is implemented in hardware. It is microcoded, and slower
+    // than magics, on AMD before Zen 3 and on Hygon.
+    [[nodiscard]] static bool hasFastPext() noexcept;
 #else
     struct Magic {
         U64       mask;
@@ -289,5 +309,18 @@ public:
      * startup.
      */
     static inline void initAttacks();
+
+    /**
+     * @brief Whether the sliding attacks are indexed with PEXT instead of magics.
+     */
+    [[nodiscard]] static bool usesPext() noexcept {
+#ifdef CHESS_USE_PEXT
+        return true;
+#elif defined(CHESS_PEXT_DISPATCH)
+        return usePext;
+#else
+        return false;
+#endif
+    }
 };
 } // namespace chess
@@ -8,6 +8,15 @@
 constexpr short MAX_HISTORY_SCORE = 10000;
 constexpr short MIN_HISTORY_SCORE = -10000;
 
+/**
+ * Apply a bonus to a history score. The closer the score is to its limit,
+ * the less it is affected, so scores never saturate.
+ */
+inline void updateHistoryScore(int16_t& ref, int16_t bonus) {
+    int diff = bonus - ref * std::abs(bonus) / MAX_HISTORY_SCORE;
+    ref      = std::clamp(ref + diff, (int) MIN_HISTORY_SCORE, (int) MAX_HISTORY_SCORE);
+}
+
 /**
  * This class keeps track of the search history.
  */
@@ -45,14 +54,25 @@ public:
 
         void clear() { std::memset(data, 0, sizeof(data)); }
 
+        /**
+         * Scale down all scores, so that they carry over to the next search
+         * while newer results have more weight.
+         */
+        void age() {
+            for (auto& fromTable : data) {
+                for (auto& toTable : fromTable) {
+                    for (auto& score : toTable) {
+                        score /= 2;
+                    }
+                }
+            }
+        }
+
         inline int16_t get(const Color stm, const Move& move) {
             return data[(int) stm][move.from().index()][move.to().index()];
         }
         inline void update(const Color stm, const Move& move, int16_t bonus) {
-            int16_t& ref  = data[(int) stm][move.from().index()][move.to().index()];
-            int      diff = bonus - ref * std::abs(bonus) / MAX_HISTORY_SCORE;
-
-            ref = std::clamp(ref + diff, (int) MIN_HISTORY_SCORE, (int) MAX_HISTORY_SCORE);
+            updateHistoryScore(data[(int) stm][move.from().index()][move.to().index()], bonus);
         }
     };
 
@@ -80,16 +100,88 @@ public:
             if (victim == PieceType::NONE) { // en passant
                 return;
             }
-            int16_t& ref  = data[(int) stm][(int) aggressor][to.index()][(int) victim];
-            int      diff = bonus - ref * std::abs(bonus) / MAX_HISTORY_SCORE;
+            updateHistoryScore(data[(int) stm][(int) aggressor][to.index()][(int) victim], bonus);
+        }
+    };
+
+    /**
+     * Continuation history. A quiet move is scored by the move played some
+     * plies before it, indexed by [prevPiece][prevTo][piece][to]. This
+     * captures follow-up patterns that the butterfly table cannot see.
+     *
+     * The previous piece is `Piece::NONE` at the start of the search and
+     * after null moves. Those entries are never updated and always read 0.
+     */
+    struct ContinuationHistoryTable {
+        struct Entry {
+            int16_t data[12][64];
+
+            inline int16_t get(const Piece piece, const Square to) const {
+                return data[(int) piece][to.index()];
+            }
+            inline void update(const Piece piece, const Square to, int16_t bonus) {
+                updateHistoryScore(data[(int) piece][to.index()], bonus);
+            }
+        };
+
+        Entry data[13][64];
+
+        void clear() { std::memset(data, 0, sizeof(data)); }
+
+        inline Entry& at(const Piece prevPiece, const Square prevTo) {
+            return data[(int) prevPiece][prevTo.index()];
+        }
+    };
+
+    /**
+     * Counter move heuristic. Remembers the quiet move that refuted the
+     * previous move, indexed by [prevPiece][prevTo].
+     */
+    struct CounterMoveTable {
+        uint16_t data[13][64];
 
-            ref = std::clamp(ref + diff, (int) MIN_HISTORY_SCORE, (int) MAX_HISTORY_SCORE);
+        void clear() { std::memset(data, 0, sizeof(data)); }
+
+        inline uint16_t get(const Piece prevPiece, const Square prevTo) const {
+            return data[(int) prevPiece][prevTo.index()];
+        }
+        inline void set(const Piece prevPiece, const Square prevTo, const Move& move) {
+            data[(int) prevPiece][prevTo.index()] = move.move();
         }
     };
 
-    KillerTable         killerTable[MAX_PLY];
-    QuietHistoryTable   qHistoryTable;
-    CaptureHistoryTable capHistoryTable;
+    /**
+     * Correction history. Learns how far the static evaluation is from the
+     * search result for positions sharing a feature, such as the pawn
+     * structure, so that the static evaluation of similar positions can be
+     * adjusted. Indexed by [stm][key % SIZE].
+     */
+    struct CorrectionHistoryTable {
+        static constexpr int SIZE  = 16384;
+        static constexpr int LIMIT = 1024;
+
+        int16_t data[2][SIZE];
+
+        void clear() { std::memset(data, 0, sizeof(data)); }
+
+        inline int16_t get(const Color stm, const uint64_t key) const {
+            return data[(int) stm][key % SIZE];
+        }
+        inline void update(const Color stm, const uint64_t key, int bonus) {
+            int16_t& ref = data[(int) stm][key % SIZE];
+            bonus        = std::clamp(bonus, -LIMIT / 4, LIMIT / 4);
+            ref += bonus - ref * std::abs(bonus) / LIMIT;
+        }
+    };
+
+    KillerTable              killerTable[MAX_PLY];
+    QuietHistoryTable        qHistoryTable;
+    CaptureHistoryTable      capHistoryTable;
+    ContinuationHistoryTable contHistory[2]; // by the move 1 and 2 plies ago
+    CounterMoveTable         counterMoveTable;
+    CorrectionHistoryTable   pawnCorrHistory;
+    CorrectionHistoryTable   nonPawnCorrHistory[2]; // by color of the pieces
+    CorrectionHistoryTable   materialCorrHistory;
 
     void clear() {
         for (int i = 0; i < MAX_PLY; i++) {
@@ -97,5 +189,14 @@ public:
         }
         qHistoryTable.clear();
         capHistoryTable.clear();
+        contHistory[0].clear();
+        contHistory[1].clear();
+        counterMoveTable.clear();
+        pawnCorrHistory.clear();
+        nonPawnCorrHistory[0].clear();
+        nonPawnCorrHistory[1].clear();
+        materialCorrHistory.clear();
     }
-};
\ No newline at end of file
+};
+
+using ContinuationHistoryEntry = SearchHistory::ContinuationHistoryTable::Entry;
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "annotate.h"
+#include "bench.h"
+#include "perft.h"
 #include "tt.h"
 #include "uci.h" // for ENGINE_VERSION
 
@@ -21,6 +23,20 @@ int main(int argc, char* argv[]) {
             } else {
                 annotate_main(argv[2]);
             }
+        } else if (mode == "movebench") {
+            // Compare make/unmake against copy-make, see bench.cpp
+            movebench_main(argc > 2 ? std::stoi(argv[2]) : 4);
+        } else if (mode == "pickbench") {
+            // Time the move picker of one node, see bench.cpp
+            pickbench_main(argc > 2 ? std::stoi(argv[2]) : 200);
+        } else if (mode == "bench") {
+            // bench [depth] [threads] [hash], see bench.cpp
+            return bench_main(argc > 2 ? std::stoi(argv[2]) : BENCH_DEPTH,
+                              argc > 3 ? std::stoi(argv[3]) : 1,
+                              argc > 4 ? std::stoi(argv[4]) : 16);
+        } else if (mode == "perft") {
+            // perft [suite|depth] [threads] [hash] [fen], see perft.cpp
+            return perft_main(argc - 2, argv + 2);
         } else {
             cout << "Unrecognized mode: " << mode << endl;
             return 1;
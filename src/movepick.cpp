@@ -17,6 +17,8 @@ constexpr int16_t CHECK_BONUS = 200;
 constexpr int16_t PROMOTION_BONUS = 200;
 // clang-format on
 
+constexpr int SEE_VALUE_MAX = 30000; // SEE values are kept in 16 bits
+
 Move MovePicker::next() {
     switch (stage) {
         case MovePickerStage::TT: {
@@ -39,15 +41,18 @@ Move MovePicker::next() {
         case MovePickerStage::GOOD_NOISY:
             // Pick a good noisy move
             while (!noisyBuffer.empty()) {
-                const auto& scoredMove = noisyBuffer.back();
+                const ScoredMove scoredMove = noisyBuffer.best();
                 if (scoredMove.score < 0) { // not a good move anymore
                     break;                  // we are done
                 }
-                noisyBuffer.pop_back();
+                noisyBuffer.popBack();
                 if (scoredMove.moveCode == ttMoveCode) {
                     continue; // do not yield the same move twice
                 }
-                return scoredMove.move();
+                if (!isLegalGenerated(scoredMove.move())) {
+                    continue;
+                }
+                return yieldNoisy(scoredMove);
             }
             stage = MovePickerStage::KILLER_1;
             [[fallthrough]];
@@ -66,12 +71,24 @@ Move MovePicker::next() {
         case MovePickerStage::KILLER_2: {
             const Move killer2 = history.killerTable[ply].killer2;
             if (killer2.isValid() && pos.isLegal<movegen::MoveGenType::QUIET>(killer2)) {
-                stage = MovePickerStage::GEN_QUIET;
+                stage = MovePickerStage::COUNTER_MOVE;
                 return killer2;
             }
         }
             [[fallthrough]];
 
+        case MovePickerStage::COUNTER_MOVE: {
+            // The counter move may coincide with a move already yielded
+            const Move counter = Move(counterMove);
+            if (counter.isValid() && counterMove != ttMoveCode &&
+                !history.killerTable[ply].has(counter) &&
+                pos.isLegal<movegen::MoveGenType::QUIET>(counter)) {
+                stage = MovePickerStage::GEN_QUIET;
+                return counter;
+            }
+        }
+            [[fallthrough]];
+
         case MovePickerStage::GEN_QUIET:
             if (_skipQuiet) { // Maybe used in pruning
                 stage = MovePickerStage::END_NORMAL;
@@ -83,16 +100,17 @@ Move MovePicker::next() {
 
         case MovePickerStage::GOOD_QUIET:
             while (!quietBuffer.empty()) {
-                const auto& scoredMove = quietBuffer.back();
+                const ScoredMove scoredMove = quietBuffer.best();
                 if (scoredMove.score < 0) { // not a good move anymore
                     break;                  // we are done
                 }
-                quietBuffer.pop_back();
-                if (scoredMove.moveCode == ttMoveCode ||
-                    scoredMove.moveCode == history.killerTable[ply].killer1 ||
-                    scoredMove.moveCode == history.killerTable[ply].killer2) {
+                quietBuffer.popBack();
+                if (scoredMove.moveCode == ttMoveCode || isKillerOrCounter(scoredMove.moveCode)) {
                     continue; // do not yield the same move twice
                 }
+                if (!isLegalGenerated(scoredMove.move())) {
+                    continue;
+                }
                 return scoredMove.move();
             }
             stage = MovePickerStage::BAD_NOISY;
@@ -100,23 +118,27 @@ Move MovePicker::next() {
 
         case MovePickerStage::BAD_NOISY:
             while (!noisyBuffer.empty()) {
-                const auto& scoredMove = noisyBuffer.back();
-                noisyBuffer.pop_back();
+                const ScoredMove scoredMove = noisyBuffer.best();
+                noisyBuffer.popBack();
                 if (scoredMove.moveCode == ttMoveCode) {
                     continue;
                 }
-                return scoredMove.move();
+                if (!isLegalGenerated(scoredMove.move())) {
+                    continue;
+                }
+                return yieldNoisy(scoredMove);
             }
             stage = MovePickerStage::BAD_QUIET;
             [[fallthrough]];
 
         case MovePickerStage::BAD_QUIET:
             while (!quietBuffer.empty()) {
-                const auto& scoredMove = quietBuffer.back();
-                quietBuffer.pop_back();
-                if (scoredMove.moveCode == ttMoveCode ||
-                    scoredMove.moveCode == history.killerTable[ply].killer1 ||
-                    scoredMove.moveCode == history.killerTable[ply].killer2) {
+                const ScoredMove scoredMove = quietBuffer.best();
+                quietBuffer.popBack();
+                if (scoredMove.moveCode == ttMoveCode || isKillerOrCounter(scoredMove.moveCode)) {
+                    continue;
+                }
+                if (!isLegalGenerated(scoredMove.move())) {
                     continue;
                 }
                 return scoredMove.move();
@@ -127,6 +149,16 @@ Move MovePicker::next() {
         case MovePickerStage::END_NORMAL:
             return Move(Move::NO_MOVE);
 
+        case MovePickerStage::QSEARCH_TT: {
+            // Outside of check, only a capture TT move belongs to qsearch
+            const Move ttMove = Move(ttMoveCode);
+            if (ttMove.isValid() && (inCheck || pos.isCapture(ttMove)) && pos.isLegal(ttMove)) {
+                stage = MovePickerStage::GEN_QSEARCH;
+                return ttMove;
+            }
+        }
+            [[fallthrough]];
+
         case MovePickerStage::GEN_QSEARCH:
             if (inCheck) {
                 generateEvasionMoves();
@@ -138,14 +170,42 @@ Move MovePicker::next() {
 
         case MovePickerStage::GOOD_QSEARCH:
             while (!noisyBuffer.empty()) {
-                const auto& scoredMove = noisyBuffer.back();
+                const ScoredMove scoredMove = noisyBuffer.best();
                 if (!inCheck && scoredMove.score < 0) {
                     break;
                 }
-                noisyBuffer.pop_back();
+                noisyBuffer.popBack();
                 if (scoredMove.moveCode == ttMoveCode) {
                     continue;
                 }
+                if (!isLegalGenerated(scoredMove.move())) {
+                    continue;
+                }
+                // Evasions are not scored by SEE
+                return inCheck ? scoredMove.move() : yieldNoisy(scoredMove);
+            }
+            stage = MovePickerStage::GEN_QSEARCH_CHECKS;
+            [[fallthrough]];
+
+        case MovePickerStage::GEN_QSEARCH_CHECKS:
+            if (!_quietChecks || inCheck) {
+                stage = MovePickerStage::END_QSEARCH;
+                return Move(Move::NO_MOVE);
+            }
+            generateQuietChecks();
+            stage = MovePickerStage::QSEARCH_CHECKS;
+            [[fallthrough]];
+
+        case MovePickerStage::QSEARCH_CHECKS:
+            while (!quietBuffer.empty()) {
+                const ScoredMove scoredMove = quietBuffer.best();
+                quietBuffer.popBack();
+                if (scoredMove.moveCode == ttMoveCode) {
+                    continue;
+                }
+                if (!isLegalGenerated(scoredMove.move())) {
+                    continue;
+                }
                 return scoredMove.move();
             }
             stage = MovePickerStage::END_QSEARCH;
@@ -154,6 +214,37 @@ Move MovePicker::next() {
         case MovePickerStage::END_QSEARCH:
             return Move(Move::NO_MOVE);
 
+        case MovePickerStage::PROBCUT_TT: {
+            const Move ttMove = Move(ttMoveCode);
+            if (ttMove.isValid() && pos.isCapture(ttMove) && pos.isLegal(ttMove) &&
+                seeValue(ttMove) >= seeThreshold) {
+                stage = MovePickerStage::GEN_PROBCUT;
+                return ttMove;
+            }
+        }
+            [[fallthrough]];
+
+        case MovePickerStage::GEN_PROBCUT:
+            generateNoisyMoves();
+            stage = MovePickerStage::GOOD_PROBCUT;
+            [[fallthrough]];
+
+        case MovePickerStage::GOOD_PROBCUT:
+            while (!noisyBuffer.empty()) {
+                const ScoredMove scoredMove = noisyBuffer.best();
+                noisyBuffer.popBack();
+                if (scoredMove.moveCode == ttMoveCode || scoredMove.see < seeThreshold ||
+                    !isLegalGenerated(scoredMove.move())) {
+                    continue;
+                }
+                return yieldNoisy(scoredMove);
+            }
+            stage = MovePickerStage::END_PROBCUT;
+            [[fallthrough]];
+
+        case MovePickerStage::END_PROBCUT:
+            return Move(Move::NO_MOVE);
+
         default:
             return Move(Move::NO_MOVE);
     }
@@ -163,11 +254,63 @@ void MovePicker::skipQuiet() {
     _skipQuiet = true;
 }
 
+void MovePicker::includeQuietChecks() {
+    _quietChecks = true;
+}
+
+bool MovePicker::isKillerOrCounter(uint16_t moveCode) const {
+    return moveCode == history.killerTable[ply].killer1 ||
+           moveCode == history.killerTable[ply].killer2 || moveCode == counterMove;
+}
+
+template <movegen::MoveGenType mt>
+void MovePicker::generateMoves(Movelist& moves) const {
+    // In check nearly all pseudo-legal moves are illegal, so the legal
+    // generator with its check mask is used instead
+    if (inCheck) {
+        movegen::legalmoves<mt>(moves, pos);
+    } else {
+        pos.pseudoLegalMoves<mt>(moves);
+    }
+}
+
+bool MovePicker::isLegalGenerated(const Move move) const {
+    return inCheck || pos.isLegalGivenPins(move, pinned);
+}
+
+Move MovePicker::yieldNoisy(const ScoredMove& scoredMove) {
+    lastNoisy = scoredMove;
+    return scoredMove.move();
+}
+
+int MovePicker::seeValue(const Move move) const {
+    if (move.move() == lastNoisy.moveCode) {
+        return lastNoisy.see;
+    }
+    if (threatCache->key == pos.hash()) {
+        return pos.seeValue(move, threatCache->maps);
+    }
+    return pos.seeValue(move);
+}
+
+const AttackMaps& MovePicker::threats() {
+    if (threatCache->key != pos.hash()) {
+        threatCache->maps = pos.attackMaps(~pos.sideToMove());
+        threatCache->key  = pos.hash();
+    }
+    return threatCache->maps;
+}
+
 void MovePicker::generateNoisyMoves() {
     Movelist noisyMoves;
-    movegen::legalmoves<movegen::MoveGenType::CAPTURE>(noisyMoves, pos);
+    generateMoves<movegen::MoveGenType::CAPTURE>(noisyMoves);
+    // Exact static exchange evaluation of all captures at once
+    int values[chess::constants::MAX_MOVES];
+    pos.seeValues(noisyMoves, values);
     // Assign scores to moves based on MVV/LVA & SEE
-    for (const Move& move : noisyMoves) {
+    for (int i = 0; i < noisyMoves.size(); ++i) {
+        const Move&     move     = noisyMoves[i];
+        const int16_t   see      = std::clamp(values[i], -SEE_VALUE_MAX, SEE_VALUE_MAX);
         int16_t         score    = 0;
         const auto      fromSq   = move.from();
         const auto      toSq     = move.to();
@@ -175,14 +318,14 @@ void MovePicker::generateNoisyMoves() {
         const PieceType victim =
             (move.typeOf() == Move::ENPASSANT) ? PieceType::PAWN : pos.at(toSq).type();
         const int16_t mvvlva = MVV_LVA_TABLE[(int) attacker][(int) victim];
-        if (pos.see(move, 0)) { // static exchange evaluation indicates an acceptable capture
+        if (see >= 0) { // static exchange evaluation indicates an acceptable capture
             score = mvvlva;
             // Additional bonus for checks
-            if (pos.isCheckMove(move)) {
+            if (pos.givesCheck(move, checkInfo)) {
                 score += CHECK_BONUS;
             }
-        } else { // a losing capture
-            score = mvvlva - 1000;
+        } else { // a losing capture, the less it loses the better
+            score = see - 1000;
         }
         // Use capture history heuristic
         const int16_t hist = history.capHistoryTable.get(pos.sideToMove(), move, pos);
@@ -190,34 +333,31 @@ void MovePicker::generateNoisyMoves() {
             score = score / 2 + hist / 8;
         }
 
-        noisyBuffer.emplace_back(ScoredMove {move.move(), score});
+        noisyBuffer.add(move.move(), score, see);
     }
-    // Sort moves by score in ascending order
-    std::sort(noisyBuffer.begin(), noisyBuffer.end());
 }
 
 void MovePicker::generateQuietMoves() {
     Movelist quietMoves;
-    movegen::legalmoves<movegen::MoveGenType::QUIET>(quietMoves, pos);
+    generateMoves<movegen::MoveGenType::QUIET>(quietMoves);
 
-    // Generate opponent threat masks
-    Bitboard threatenedBy[6];
+    // Generate opponent threat masks from the attack maps of the node
+    const AttackMaps& maps = threats();
+    Bitboard          threatenedBy[6];
     threatenedBy[(int) TYPE_PAWN]   = 0;
-    threatenedBy[(int) TYPE_KNIGHT] = pos.getAttackMap<TYPE_PAWN>(~pos.sideToMove());
+    threatenedBy[(int) TYPE_KNIGHT] = maps.byType[(int) TYPE_PAWN];
     threatenedBy[(int) TYPE_BISHOP] = threatenedBy[(int) TYPE_PAWN];
     threatenedBy[(int) TYPE_ROOK]   = threatenedBy[(int) TYPE_KNIGHT] |
-                                    pos.getAttackMap<TYPE_BISHOP>(~pos.sideToMove()) |
-                                    pos.getAttackMap<TYPE_KNIGHT>(~pos.sideToMove());
-    threatenedBy[(int) TYPE_QUEEN] =
-        threatenedBy[(int) TYPE_ROOK] | pos.getAttackMap<TYPE_QUEEN>(~pos.sideToMove());
-    threatenedBy[(int) TYPE_KING] =
-        threatenedBy[(int) TYPE_QUEEN] | pos.getAttackMap<TYPE_QUEEN>(~pos.sideToMove());
+                                    maps.byType[(int) TYPE_BISHOP] |
+                                    maps.byType[(int) TYPE_KNIGHT];
+    threatenedBy[(int) TYPE_QUEEN] = threatenedBy[(int) TYPE_ROOK] | maps.byType[(int) TYPE_QUEEN];
+    threatenedBy[(int) TYPE_KING]  = threatenedBy[(int) TYPE_QUEEN];
     static constexpr int16_t PT_WEIGHT[] = {0, 2, 2, 4, 8, 16, 100};
 
     for (const Move& move : quietMoves) {
-        int16_t score = 0;
+        int score = 0;
         // Bonus for checks
-        if (pos.isCheckMove(move)) {
+        if (pos.givesCheck(move, checkInfo)) {
             score += CHECK_BONUS;
         }
         // Promotion bonus
@@ -228,19 +368,24 @@ void MovePicker::generateQuietMoves() {
         // and bonus for escaping from them
         const auto    fromSq    = move.from().index();
         const auto    toSq      = move.to().index();
-        const auto    pieceType = pos.at(move.from()).type();
+        const Piece   piece     = pos.at(move.from());
+        const auto    pieceType = piece.type();
         const int16_t v         = (threatenedBy[(int) pieceType].check(toSq))     ? -95
                                   : (threatenedBy[(int) pieceType].check(fromSq)) ? 100
                                                                                   : 0;
         score += v * PT_WEIGHT[(int) pieceType];
 
-        // Assign score from quiet history
+        // Assign score from quiet history and continuation history
         int historyScore = history.qHistoryTable.get(pos.sideToMove(), move);
+        if (contHist[0]) {
+            historyScore += contHist[0]->get(piece, move.to());
+            historyScore += contHist[1]->get(piece, move.to());
+        }
         score += historyScore / 4;
 
-        quietBuffer.emplace_back(ScoredMove {move.move(), score});
+        score = std::clamp(score, (int) INT16_MIN, (int) INT16_MAX);
+        quietBuffer.add(move.move(), (int16_t) score);
     }
-    std::sort(quietBuffer.begin(), quietBuffer.end());
 }
 
 void MovePicker::generateEvasionMoves() {
@@ -248,6 +393,18 @@ void MovePicker::generateEvasionMoves() {
     movegen::legalmoves(moves, pos);
     for (const Move& move : moves) {
         int16_t historyScore = (int16_t) history.qHistoryTable.get(pos.sideToMove(), move);
-        noisyBuffer.emplace_back(ScoredMove {move.move(), historyScore});
+        noisyBuffer.add(move.move(), historyScore);
+    }
+}
+
+void MovePicker::generateQuietChecks() {
+    Movelist quietMoves;
+    generateMoves<movegen::MoveGenType::QUIET>(quietMoves);
+    for (const Move& move : quietMoves) {
+        if (!pos.givesCheck(move, checkInfo)) {
+            continue;
+        }
+        const int16_t historyScore = history.qHistoryTable.get(pos.sideToMove(), move);
+        quietBuffer.add(move.move(), historyScore);
     }
 }
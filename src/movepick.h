@@ -3,7 +3,7 @@
 #include "history.h"
 #include "position.h"
 #include "types.h"
-#include <vector>
+#include <utility>
 
 namespace {
 enum class MovePickerStage {
@@ -12,55 +12,188 @@ enum class MovePickerStage {
     GOOD_NOISY,
     KILLER_1,
     KILLER_2,
+    COUNTER_MOVE,
     GEN_QUIET,
     GOOD_QUIET,
     BAD_NOISY,
     BAD_QUIET,
     END_NORMAL,
 
+    QSEARCH_TT,
     GEN_QSEARCH,
     GOOD_QSEARCH,
-    END_QSEARCH
+    GEN_QSEARCH_CHECKS,
+    QSEARCH_CHECKS,
+    END_QSEARCH,
+
+    PROBCUT_TT,
+    GEN_PROBCUT,
+    GOOD_PROBCUT,
+    END_PROBCUT
 };
 }
 
+/**
+ * Attack maps of the opponent of a node, computed at most once per node. The
+ * search keeps one per ply, so that a re-search of the same node, as in
+ * singular extension, reuses them.
+ */
+struct ThreatCache {
+    uint64_t   key = 0; // key of the position the maps belong to, 0 if none
+    AttackMaps maps;
+};
+
 class MovePicker {
 private:
     struct ScoredMove {
         uint16_t moveCode;
         int16_t  score;
+        int16_t  see; // exact SEE value of noisy moves, 0 for quiet moves
 
         bool operator<(const ScoredMove& other) const { return score < other.score; }
         bool operator>(const ScoredMove& other) const { return score > other.score; }
         Move move() const { return Move(moveCode); }
     };
 
+    /**
+     * Fixed-capacity list of scored moves. Moves are not sorted up front;
+     * the best remaining one is selected when needed, since most nodes only
+     * use a few moves before a cutoff.
+     */
+    struct ScoredMoveList {
+        ScoredMove moves[chess::constants::MAX_MOVES];
+        int        count = 0;
+
+        bool empty() const { return count == 0; }
+        void add(uint16_t moveCode, int16_t score, int16_t see = 0) {
+            moves[count++] = {moveCode, score, see};
+        }
+
+        /**
+         * Move the best remaining move to the back and return it. It stays in
+         * the list until `popBack` is called.
+         */
+        const ScoredMove& best() {
+            int bestIndex = count - 1;
+            for (int i = 0; i < count - 1; ++i) {
+                if (moves[i].score > moves[bestIndex].score) {
+                    bestIndex = i;
+                }
+            }
+            std::swap(moves[bestIndex], moves[count - 1]);
+            return moves[count - 1];
+        }
+        void popBack() { --count; }
+    };
+
     Position&      pos;
     SearchHistory& history;
     uint16_t       ttMoveCode;
-    bool           _skipQuiet; // when enabled, skips everything after GOOD_NOISY
+    bool           _skipQuiet;   // when enabled, skips everything after GOOD_NOISY
+    bool           _quietChecks; // when enabled, qsearch also yields quiet checks
     bool           inCheck;
     int            ply;
+    int            seeThreshold; // minimum SEE of captures yielded in ProbCut
+
+    // Continuation history entries of the moves 1 and 2 plies ago, and the
+    // counter move to the previous move. Not used in quiescence search.
+    const ContinuationHistoryEntry* contHist[2];
+    uint16_t                        counterMove;
+
+    // Opponent attack maps, for quiet scoring and SEE. Points to the cache of
+    // the search stack if given one, else to the picker's own.
+    ThreatCache  ownThreats;
+    ThreatCache* threatCache;
 
-    std::vector<ScoredMove> quietBuffer;
-    std::vector<ScoredMove> noisyBuffer;
-    MovePickerStage         stage;
+    // Check information of this node, for scoring checking moves
+    CheckInfo checkInfo;
+    // Own pieces pinned to our king. Outside of check, moves are generated
+    // pseudo-legal and only checked for legality when yielded.
+    Bitboard pinned;
+
+    ScoredMoveList  quietBuffer;
+    ScoredMoveList  noisyBuffer;
+
+    // The last noisy move yielded, with its SEE value for seeValue()
+    ScoredMove lastNoisy = {Move::NO_MOVE, 0, 0};
+
+    MovePickerStage stage;
 
 private:
     void generateNoisyMoves();
     void generateQuietMoves();
     void generateEvasionMoves();
+    void generateQuietChecks();
+
+    template <movegen::MoveGenType mt>
+    void generateMoves(Movelist& moves) const;
+    bool isLegalGenerated(const Move move) const;
+
+    bool isKillerOrCounter(uint16_t moveCode) const;
+    const AttackMaps& threats();
+    Move yieldNoisy(const ScoredMove& scoredMove);
 
 public:
     MovePicker(
-        Position& pos, SearchHistory& history, int ply, uint16_t ttMoveCode, bool isQsearch) :
-        pos(pos), history(history), ply(ply), ttMoveCode(ttMoveCode), _skipQuiet(false) {
-        inCheck = pos.inCheck();
-        stage   = isQsearch ? MovePickerStage::GEN_QSEARCH : MovePickerStage::TT;
+        Position&                             pos,
+        SearchHistory&                        history,
+        int                                   ply,
+        uint16_t                              ttMoveCode,
+        bool                                  isQsearch,
+        const ContinuationHistoryEntry* const contHist[2] = nullptr,
+        uint16_t                              counterMove = 0,
+        ThreatCache*                          threatCache = nullptr) :
+        pos(pos),
+        history(history),
+        ply(ply),
+        ttMoveCode(ttMoveCode),
+        _skipQuiet(false),
+        _quietChecks(false),
+        counterMove(counterMove),
+        threatCache(threatCache ? threatCache : &ownThreats) {
+        inCheck           = pos.inCheck();
+        checkInfo         = pos.checkInfo();
+        pinned            = pos.pinnedPieces();
+        stage             = isQsearch ? MovePickerStage::QSEARCH_TT : MovePickerStage::TT;
+        this->contHist[0] = contHist ? contHist[0] : nullptr;
+        this->contHist[1] = contHist ? contHist[1] : nullptr;
+    }
+
+    /**
+     * Move picker for ProbCut. Only captures whose static exchange
+     * evaluation beats `seeThreshold` are yielded.
+     */
+    MovePicker(
+        Position& pos, SearchHistory& history, int ply, uint16_t ttMoveCode, int seeThreshold) :
+        pos(pos),
+        history(history),
+        ply(ply),
+        ttMoveCode(ttMoveCode),
+        _skipQuiet(false),
+        _quietChecks(false),
+        seeThreshold(seeThreshold),
+        counterMove(0),
+        threatCache(&ownThreats) {
+        inCheck     = pos.inCheck();
+        checkInfo   = pos.checkInfo();
+        pinned      = pos.pinnedPieces();
+        stage       = MovePickerStage::PROBCUT_TT;
+        contHist[0] = nullptr;
+        contHist[1] = nullptr;
     }
 
     Move next();
     void skipQuiet();
+    void includeQuietChecks();
+
+    /**
+     * Exact SEE value of a move of this node. For the noisy move yielded
+     * last, the value computed when scoring it is reused. Once quiet moves
+     * are scored, the opponent attack maps decide most quiet moves without
+     * playing out an exchange.
+     */
+    int seeValue(const Move move) const;
 
     const MovePickerStage& getStage() const { return stage; }
+    const CheckInfo&       getCheckInfo() const { return checkInfo; }
 };
\ No newline at end of file
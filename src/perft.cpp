@@ -0,0 +1,241 @@
+#include "perft.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct PerftCase {
+    const char* fen;
+    int         depth;
+    uint64_t    nodes;
+};
+
+// Positions of the Chess Programming Wiki perft page, at depths that run in
+// seconds. They cover castling, en passant, promotions, pins and checks.
+const PerftCase PERFT_SUITE[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5, 4865609},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6, 11030083},
+    {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5, 15833292},
+    {"r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1", 5, 15833292},
+    {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487},
+    {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594},
+};
+
+/**
+ * Table of subtree node counts, shared by the threads without locks. An entry
+ * stores its key xor its data, so that an entry torn by two threads writing
+ * at once fails the check instead of returning a wrong count.
+ */
+class PerftTable {
+public:
+    explicit PerftTable(int megabytes) {
+        const size_t count = (size_t) megabytes * 1024 * 1024 / sizeof(Entry);
+        if (count > 0) {
+            size_t size = 1;
+            while (size * 2 <= count) {
+                size *= 2;
+            }
+            entries = std::make_unique<Entry[]>(size);
+            mask    = size - 1;
+        }
+    }
+
+    bool probe(const uint64_t key, const int depth, uint64_t& nodes) const {
+        if (!entries) {
+            return false;
+        }
+        const Entry&   entry = entries[index(key, depth)];
+        const uint64_t data  = entry.data.load(std::memory_order_relaxed);
+        if ((entry.check.load(std::memory_order_relaxed) ^ data) != key ||
+            (int) (data & 0xff) != depth) {
+            return false;
+        }
+        nodes = data >> 8;
+        return true;
+    }
+
+    void store(const uint64_t key, const int depth, const uint64_t nodes) {
+        if (!entries) {
+            return;
+        }
+        Entry&         entry = entries[index(key, depth)];
+        const uint64_t data  = (nodes << 8) | depth;
+        entry.check.store(key ^ data, std::memory_order_relaxed);
+        entry.data.store(data, std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> check{0};
+        std::atomic<uint64_t> data{0};
+    };
+
+    size_t index(const uint64_t key, const int depth) const {
+        return (key ^ (depth * 0x9E3779B97F4A7C15ULL)) & mask;
+    }
+
+    std::unique_ptr<Entry[]> entries;
+    size_t                   mask = 0;
+};
+
+/**
+ * Generate the legal moves the way MovePicker does, so that perft checks the
+ * move generation used by the search: pseudo-legal moves filtered by pins,
+ * or the legal generator when in check.
+ */
+void generateLegalMoves(const Position& pos, Movelist& moves) {
+    if (pos.inCheck()) {
+        movegen::legalmoves(moves, pos);
+        return;
+    }
+    Movelist pseudo;
+    pos.pseudoLegalMoves(pseudo);
+    const Bitboard pinned = pos.pinnedPieces();
+    for (const Move& move : pseudo) {
+        if (pos.isLegalGivenPins(move, pinned)) {
+            moves.add(move);
+        }
+    }
+}
+
+uint64_t perft(Position& pos, const int depth, PerftTable& table) {
+    if (depth == 0) {
+        return 1;
+    }
+    uint64_t nodes = 0;
+    if (depth >= 2 && table.probe(pos.hash(), depth, nodes)) {
+        return nodes;
+    }
+
+    Movelist moves;
+    generateLegalMoves(pos, moves);
+    // Bulk counting: the moves at the last ply need not be made
+    if (depth == 1) {
+        return moves.size();
+    }
+    PositionState undo;
+    for (const Move& move : moves) {
+        pos.makeMove(move, undo);
+        nodes += perft(pos, depth - 1, table);
+        pos.unmakeMove(undo);
+    }
+    table.store(pos.hash(), depth, nodes);
+    return nodes;
+}
+
+/**
+ * Count the nodes below each root move, with the threads taking the next
+ * unclaimed root move until none is left.
+ */
+std::vector<uint64_t> countRootMoves(const Position& root, const Movelist& moves, const int depth,
+                                     const int threads, PerftTable& table) {
+    std::vector<uint64_t>    counts(moves.size());
+    std::atomic<int>         next{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < std::max(threads, 1); ++t) {
+        workers.emplace_back([&]() {
+            Position pos = root;
+            for (int i = next++; i < moves.size(); i = next++) {
+                PositionState undo;
+                pos.makeMove(moves[i], undo);
+                counts[i] = perft(pos, depth - 1, table);
+                pos.unmakeMove(undo);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return counts;
+}
+
+uint64_t perftThreaded(const Position& root, const int depth, const int threads,
+                       PerftTable& table, Movelist& moves, std::vector<uint64_t>& counts) {
+    generateLegalMoves(root, moves);
+    if (depth <= 1) {
+        counts.assign(moves.size(), 1);
+        return depth == 1 ? moves.size() : 1;
+    }
+    counts = countRootMoves(root, moves, depth, threads, table);
+    uint64_t nodes = 0;
+    for (uint64_t count : counts) {
+        nodes += count;
+    }
+    return nodes;
+}
+
+double secondsSince(const std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Run the suite and compare with the known counts.
+ */
+int runSuite(const int threads, const int hashMB) {
+    uint64_t   total    = 0;
+    int        failures = 0;
+    const auto start    = std::chrono::steady_clock::now();
+    for (const PerftCase& c : PERFT_SUITE) {
+        PerftTable            table(hashMB);
+        Position              pos(c.fen);
+        Movelist              moves;
+        std::vector<uint64_t> counts;
+
+        const uint64_t nodes = perftThreaded(pos, c.depth, threads, table, moves, counts);
+        const bool     ok    = nodes == c.nodes;
+        failures += !ok;
+        total += nodes;
+        std::cout << (ok ? "ok   " : "FAIL ") << "depth " << c.depth << " nodes " << nodes;
+        if (!ok) {
+            std::cout << " expected " << c.nodes;
+        }
+        std::cout << "  " << c.fen << std::endl;
+    }
+    const double seconds = secondsSince(start);
+    std::cout << "\n"
+              << failures << " failed, " << total << " nodes, " << (int) (seconds * 1000)
+              << " ms, " << (uint64_t) (total / seconds) << " nps" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace
+
+uint64_t perft_divide(const Position& pos, const int depth, const int threads, const int hashMB) {
+    // The key history of the position only has room for MAX_PLY more plies
+    if (depth > MAX_PLY) {
+        std::cout << "info string perft depth is limited to " << MAX_PLY << std::endl;
+        return 0;
+    }
+    PerftTable            table(hashMB);
+    Movelist              moves;
+    std::vector<uint64_t> counts;
+
+    const auto     start   = std::chrono::steady_clock::now();
+    const uint64_t nodes   = perftThreaded(pos, depth, threads, table, moves, counts);
+    const double   seconds = secondsSince(start);
+    for (int i = 0; i < moves.size(); ++i) {
+        std::cout << moves[i] << ": " << counts[i] << std::endl;
+    }
+    std::cout << "\nNodes searched: " << nodes << " (" << (int) (seconds * 1000) << " ms, "
+              << (uint64_t) (nodes / std::max(seconds, 1e-9)) << " nps)" << std::endl;
+    return nodes;
+}
+
+int perft_main(int argc, char* argv[]) {
+    const bool suite   = argc < 1 || std::string(argv[0]) == "suite";
+    const int  threads = argc > 1 ? std::stoi(argv[1]) : 1;
+    const int  hashMB  = argc > 2 ? std::stoi(argv[2]) : 16;
+    if (suite) {
+        return runSuite(threads, hashMB);
+    }
+    const Position pos(argc > 3 ? argv[3] : chess::constants::STARTPOS);
+    perft_divide(pos, std::stoi(argv[0]), threads, hashMB);
+    return 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "position.h"
+#include <cstdint>
+
+/**
+ * Count the leaf nodes of the legal move tree of `pos` at `depth`, and print
+ * the count below each root move. The root moves are split over `threads`,
+ * and subtree counts are cached in a table of `hashMB` megabytes (0 to
+ * disable).
+ */
+uint64_t perft_divide(const Position& pos, int depth, int threads, int hashMB);
+
+/**
+ * Command line perft: either the standard suite with known counts, or a
+ * divide of one position. Returns the process exit code.
+ */
+int perft_main(int argc, char* argv[]);
@@ -0,0 +1,147 @@
+#include "position.h"
+
+namespace {
+
+/**
+ * Reads the Zobrist keys of chesslib, which are private to Board, by hashing
+ * a board that holds a single piece.
+ */
+struct ZobristProbe : Board {
+    ZobristProbe() {
+        pieces_bb_ = {};
+        occ_bb_    = {};
+        board_.fill(Piece::NONE);
+        cr_.clear();
+        ep_sq_ = Square::NO_SQ;
+        stm_   = BLACK;
+    }
+
+    uint64_t piece(const Piece piece, const Square sq) {
+        placePiece(piece, sq);
+        const uint64_t key = zobrist();
+        removePiece(piece, sq);
+        return key;
+    }
+
+    uint64_t sideToMove() {
+        stm_               = WHITE;
+        const uint64_t key = zobrist();
+        stm_               = BLACK;
+        return key;
+    }
+};
+
+constexpr int CUCKOO_SIZE = 8192;
+
+inline int cuckooH1(const uint64_t key) { return key & (CUCKOO_SIZE - 1); }
+inline int cuckooH2(const uint64_t key) { return (key >> 16) & (CUCKOO_SIZE - 1); }
+
+/**
+ * Cuckoo hash tables of the key changes of all reversible moves, i.e. moves
+ * of pieces other than pawns between two squares on an empty board. Both
+ * directions of a move change the key the same way, so a move is stored
+ * once.
+ */
+struct CuckooTables {
+    uint64_t keys[CUCKOO_SIZE] = {};
+    Move     moves[CUCKOO_SIZE] = {};
+    uint64_t sideKey;
+
+    CuckooTables() {
+        ZobristProbe probe;
+        sideKey = probe.sideToMove();
+
+        for (int p = 0; p < 12; ++p) {
+            const Piece piece(static_cast<Piece::underlying>(p));
+            if (piece.type() == PieceType::PAWN) {
+                continue;
+            }
+            for (int s1 = 0; s1 < 64; ++s1) {
+                for (int s2 = s1 + 1; s2 < 64; ++s2) {
+                    if (!attacks(piece.type(), s1).check(s2)) {
+                        continue;
+                    }
+                    Move     move = Move::make(Square(s1), Square(s2));
+                    uint64_t key  = probe.piece(piece, Square(s1)) ^
+                                   probe.piece(piece, Square(s2)) ^ sideKey;
+                    // Insert, kicking out the previous entry into its other slot
+                    int i = cuckooH1(key);
+                    while (true) {
+                        std::swap(keys[i], key);
+                        std::swap(moves[i], move);
+                        if (move == Move::NO_MOVE) {
+                            break;
+                        }
+                        i = (i == cuckooH1(key)) ? cuckooH2(key) : cuckooH1(key);
+                    }
+                }
+            }
+        }
+    }
+
+    static Bitboard attacks(const PieceType pt, const Square sq) {
+        switch (pt.internal()) {
+        case PieceType::KNIGHT: return attacks::knight(sq);
+        case PieceType::BISHOP: return attacks::bishop(sq, 0);
+        case PieceType::ROOK: return attacks::rook(sq, 0);
+        case PieceType::QUEEN: return attacks::queen(sq, 0);
+        default: return attacks::king(sq);
+        }
+    }
+};
+
+const CuckooTables cuckoo;
+
+} // namespace
+
+bool Position::hasUpcomingRepetition(const int ply) const {
+    const int end = std::min({int(hfm_), pliesFromNull, keyCount});
+    if (end < 3) {
+        return false;
+    }
+
+    // Key of the position `d` plies before the current one
+    const auto past = [this](int d) { return keyHistory[keyCount - d]; };
+
+    // `other` is zero when the moves between the two positions, except the
+    // one to be found, cancel out
+    uint64_t other = key_ ^ past(1) ^ cuckoo.sideKey;
+    for (int i = 3; i <= end; i += 2) {
+        other ^= past(i - 1) ^ past(i) ^ cuckoo.sideKey;
+        if (other != 0) {
+            continue;
+        }
+
+        const uint64_t moveKey = key_ ^ past(i);
+        int            j       = cuckooH1(moveKey);
+        if (cuckoo.keys[j] != moveKey) {
+            j = cuckooH2(moveKey);
+            if (cuckoo.keys[j] != moveKey) {
+                continue;
+            }
+        }
+
+        const Move   move = cuckoo.moves[j];
+        const Square s1   = move.from();
+        const Square s2   = move.to();
+        if ((movegen::between(s1, s2) ^ Bitboard::fromSquare(s2)) & occ()) {
+            continue;
+        }
+        // Repeating a position after the root is a draw
+        if (ply > i) {
+            return true;
+        }
+        // Otherwise the move must be ours, and the position must have
+        // occurred before, so that playing the move repeats it three times
+        const Square sq = at(s1) == Piece::NONE ? s2 : s1;
+        if (at(sq).color() != sideToMove()) {
+            continue;
+        }
+        for (int k = i + 2; k <= std::min(int(hfm_), keyCount); k += 2) {
+            if (past(k) == past(i)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
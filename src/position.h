@@ -2,25 +2,255 @@
 
 #include "chess.hpp"
 #include "types.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <cmath>
+#include <type_traits>
 
 constexpr int SEE_PIECE_VALUE[] = {100, 300, 320, 550, 1000, 99999, 0};
 
+/**
+ * Random keys by piece and square, generated with splitmix64 from `seed`.
+ * The incremental keys of Position use these instead of the Zobrist keys of
+ * chesslib, which are private to Board.
+ */
+constexpr std::array<std::array<uint64_t, 64>, 12> makeKeyTable(uint64_t seed) {
+    std::array<std::array<uint64_t, 64>, 12> table{};
+    for (auto& keys : table) {
+        for (auto& key : keys) {
+            uint64_t x = (seed += 0x9E3779B97F4A7C15ULL);
+            x          = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x          = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            key        = x ^ (x >> 31);
+        }
+    }
+    return table;
+}
+
+inline constexpr auto PIECE_SQUARE_KEYS = makeKeyTable(0x2545F4914F6CDD1DULL);
+// Indexed by piece and number of such pieces, rather than by square
+inline constexpr auto MATERIAL_KEYS = makeKeyTable(0x9FB21C651E98DF25ULL);
+
+/**
+ * Information about checks against the opponent king, computed once per
+ * node so that checking moves can be recognized without making them.
+ */
+struct CheckInfo {
+    Bitboard checkSquares[6]; // squares giving direct check, by piece type
+    Bitboard discoverers;     // own pieces that uncover a check when moving off the line
+    Square   kingSq;          // square of the opponent king
+};
+
+/**
+ * Squares attacked by the pieces of one side, by piece type.
+ */
+struct AttackMaps {
+    Bitboard byType[6];
+    Bitboard all; // union of the above
+};
+
+/**
+ * Compact copy of the board state, without the history of previous
+ * positions. The search saves one per ply and undoes a move by copying it
+ * back, instead of reverting each change of the move.
+ */
+struct PositionState {
+    std::array<Bitboard, 6> pieces;
+    std::array<Bitboard, 2> occupancy;
+    std::array<Piece, 64>   board;
+    uint64_t                key;
+    Board::CastlingRights   castling;
+    uint16_t                plies;
+    Color                   sideToMove;
+    Square                  epSquare;
+    uint8_t                 halfMoveClock;
+    uint16_t                keyCount;      // length of the key history
+    uint16_t                pliesFromNull; // plies since the last null move
+    uint64_t                pawnKey;
+    uint64_t                nonPawnKey[2];
+    uint64_t                materialKey;
+};
+static_assert(std::is_trivially_copyable_v<PositionState>);
+
 /**
  * Simple extension to Board with extra helper functions.
  */
 class Position : public Board {
 public:
-    using Board::Board; // Inherit the constructor
+    explicit Position(std::string_view fen = chess::constants::STARTPOS, bool chess960 = false)
+        : Board(fen, chess960) {
+        refreshKeys();
+    }
+
+    bool setFen(std::string_view fen) override {
+        keyCount      = 0;
+        pliesFromNull = 0;
+        const bool ok = Board::setFen(fen);
+        refreshKeys();
+        return ok;
+    }
 
     /**
-     * @brief Check if a move puts the other side in check
+     * Make a move in the game. Use the overload taking a `PositionState` in
+     * search.
      */
-    bool isCheckMove(const Move move) {
-        makeMove(move);
-        bool check = inCheck();
-        unmakeMove(move);
-        return check;
+    void makeMove(const Move move) {
+        if (keyCount >= KEY_HISTORY_SIZE - MAX_PLY) {
+            // Keep room for the search. Only the keys since the last
+            // irreversible move can repeat, and there are fewer than 256.
+            std::copy(keyHistory.begin() + keyCount - 256, keyHistory.begin() + keyCount,
+                      keyHistory.begin());
+            keyCount = 256;
+        }
+        pushKey();
+        ++pliesFromNull;
+        Board::makeMove(move);
+    }
+
+    void unmakeMove(const Move move) {
+        --keyCount;
+        pliesFromNull = std::max(pliesFromNull - 1, 0);
+        Board::unmakeMove(move);
+    }
+
+    void makeNullMove() {
+        pushKey();
+        pliesFromNull = 0;
+        Board::makeNullMove();
+    }
+
+    // The plies before the null move are not counted again, which only makes
+    // the upcoming repetition check more conservative.
+    void unmakeNullMove() {
+        --keyCount;
+        Board::unmakeNullMove();
+    }
+
+    /**
+     * Make a move by copy-make. The state before the move is saved to `undo`,
+     * and `unmakeMove(undo)` copies it back. The previous-state stack of
+     * Board is not used.
+     */
+    void makeMove(const Move move, PositionState& undo) {
+        saveState(undo);
+        pushKey();
+        ++pliesFromNull;
+        Board::makeMove(move);
+        prev_states_.pop_back();
+    }
+
+    void makeNullMove(PositionState& undo) {
+        saveState(undo);
+        pushKey();
+        pliesFromNull = 0;
+        Board::makeNullMove();
+        prev_states_.pop_back();
+    }
+
+    void unmakeMove(const PositionState& undo) {
+        pieces_bb_     = undo.pieces;
+        occ_bb_        = undo.occupancy;
+        board_         = undo.board;
+        key_           = undo.key;
+        cr_            = undo.castling;
+        plies_         = undo.plies;
+        stm_           = undo.sideToMove;
+        ep_sq_         = undo.epSquare;
+        hfm_           = undo.halfMoveClock;
+        keyCount       = undo.keyCount;
+        pliesFromNull  = undo.pliesFromNull;
+        pawnKey_       = undo.pawnKey;
+        materialKey_   = undo.materialKey;
+        nonPawnKey_[0] = undo.nonPawnKey[0];
+        nonPawnKey_[1] = undo.nonPawnKey[1];
+    }
+
+    /**
+     * Check if the current position occurred `count` times before, since the
+     * last irreversible move.
+     */
+    bool isRepetition(int count = 2) const {
+        int c = 0;
+        for (int i = keyCount - 2; i >= 0 && i >= keyCount - hfm_ - 1; i -= 2) {
+            if (keyHistory[i] == key_ && ++c == count) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Check for a repetition in search, at `ply` from the root. Returning to
+     * a position after the root already counts, any earlier position must
+     * have occurred twice.
+     */
+    bool isRepetitionInSearch(const int ply) const {
+        int c = 0;
+        for (int i = keyCount - 2; i >= 0 && i >= keyCount - hfm_ - 1; i -= 2) {
+            if (keyHistory[i] == key_ && (keyCount - i < ply || ++c == 2)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Check if the side to move has a reversible move that repeats a position,
+     * at `ply` from the root, without generating the moves. Uses the cuckoo
+     * tables of position.cpp, see "Efficient detection of repetitions" by
+     * M. N. J. van Kervinck.
+     */
+    bool hasUpcomingRepetition(int ply) const;
+
+    /**
+     * Compute the check information of the side to move.
+     */
+    CheckInfo checkInfo() const {
+        CheckInfo    ci;
+        const Color  color = sideToMove();
+        const Square ksq   = kingSq(~color);
+        for (PieceType pt :
+             {TYPE_PAWN, TYPE_KNIGHT, TYPE_BISHOP, TYPE_ROOK, TYPE_QUEEN, TYPE_KING}) {
+            ci.checkSquares[(int) pt] = checkSquares(pt);
+        }
+        ci.kingSq = ksq;
+
+        // Own sliders aiming at the king through exactly one own piece
+        ci.discoverers       = Bitboard(0);
+        const Bitboard queens = pieces(TYPE_QUEEN, color);
+        Bitboard       snipers =
+            (attacks::bishop(ksq, Bitboard(0)) & (pieces(TYPE_BISHOP, color) | queens)) |
+            (attacks::rook(ksq, Bitboard(0)) & (pieces(TYPE_ROOK, color) | queens));
+        while (snipers) {
+            const Square   sniper   = snipers.pop();
+            const Bitboard blockers = movegen::between(ksq, sniper) & occ() &
+                                      ~Bitboard::fromSquare(sniper);
+            if (blockers.count() == 1 && (blockers & us(color))) {
+                ci.discoverers |= blockers;
+            }
+        }
+        return ci;
+    }
+
+    /**
+     * Check if a move puts the other side in check, using the check
+     * information of this position. Only promotions, en passant and castling
+     * need more than a few bitboard operations.
+     */
+    bool givesCheck(const Move move, const CheckInfo& ci) const {
+        if (move.typeOf() != Move::NORMAL) {
+            return Board::givesCheck(move) != chess::CheckType::NO_CHECK;
+        }
+        const Square from = move.from();
+        const Square to   = move.to();
+        if (ci.checkSquares[(int) at(from).type()].check(to.index())) {
+            return true;
+        }
+        // Discovered check, unless the piece stays on the line to the king
+        return ci.discoverers.check(from.index()) &&
+               !movegen::between(ci.kingSq, from).check(to.index()) &&
+               !movegen::between(ci.kingSq, to).check(from.index());
     }
 
     /**
@@ -32,6 +262,145 @@ public:
         return moves; // Let RVO take care of this, no need for std::move
     }
 
+    /**
+     * Generate pseudo-legal moves of the side to move, i.e. moves that may
+     * leave the own king attacked. The move type selects captures or quiet
+     * moves in the same way as in legal move generation. No pins or checks
+     * are computed here; use `isLegalGivenPins` on the moves actually tried.
+     * Castling moves are fully legal already.
+     */
+    template <movegen::MoveGenType mt = movegen::MoveGenType::ALL>
+    void pseudoLegalMoves(Movelist& moves) const {
+        constexpr bool genCaptures = mt != movegen::MoveGenType::QUIET;
+        constexpr bool genQuiets   = mt != movegen::MoveGenType::CAPTURE;
+
+        const Color    color    = sideToMove();
+        const Bitboard occupied = occ();
+        const Bitboard enemy    = them(color);
+        const Bitboard targets  = (genCaptures ? enemy : Bitboard(0)) |
+                                 (genQuiets ? ~occupied : Bitboard(0));
+
+        // Pawns
+        const Bitboard pawns    = pieces(TYPE_PAWN, color);
+        const Bitboard lastRank = Bitboard(color == WHITE ? 0xFF00000000000000ULL : 0xFFULL);
+        const Bitboard pushRank = Bitboard(color == WHITE ? 0xFF0000ULL : 0xFF0000000000ULL);
+        const int      forward  = color == WHITE ? 8 : -8;
+        const auto     addPawnMove = [&](const Square from, const Square to) {
+            if (lastRank.check(to.index())) {
+                for (PieceType pt : {TYPE_QUEEN, TYPE_ROOK, TYPE_BISHOP, TYPE_KNIGHT}) {
+                    moves.add(Move::make<Move::PROMOTION>(from, to, pt));
+                }
+            } else {
+                moves.add(Move::make<Move::NORMAL>(from, to));
+            }
+        };
+        if (genCaptures) {
+            Bitboard bb = pawns;
+            while (bb) {
+                const Square from     = bb.pop();
+                Bitboard     captures = attacks::pawn(color, from) & enemy;
+                while (captures) {
+                    addPawnMove(from, captures.pop());
+                }
+            }
+            const Square ep = enpassantSq();
+            if (ep != Square::NO_SQ) {
+                Bitboard capturers = attacks::pawn(~color, ep) & pawns;
+                while (capturers) {
+                    moves.add(Move::make<Move::ENPASSANT>(capturers.pop(), ep));
+                }
+            }
+        }
+        if (genQuiets) {
+            const Bitboard empty      = ~occupied;
+            const Bitboard singlePush = (color == WHITE ? pawns << 8 : pawns >> 8) & empty;
+            Bitboard       doublePush =
+                (color == WHITE ? (singlePush & pushRank) << 8 : (singlePush & pushRank) >> 8) &
+                empty;
+            Bitboard bb = singlePush;
+            while (bb) {
+                const Square to = bb.pop();
+                addPawnMove(Square(to.index() - forward), to);
+            }
+            while (doublePush) {
+                const Square to = doublePush.pop();
+                moves.add(Move::make<Move::NORMAL>(Square(to.index() - 2 * forward), to));
+            }
+        }
+
+        // Pieces and the king
+        for (PieceType pt : {TYPE_KNIGHT, TYPE_BISHOP, TYPE_ROOK, TYPE_QUEEN, TYPE_KING}) {
+            Bitboard bb = pieces(pt, color);
+            while (bb) {
+                const Square from = bb.pop();
+                Bitboard     to   = pieceAttacks(pt, from) & targets;
+                while (to) {
+                    moves.add(Move::make<Move::NORMAL>(from, to.pop()));
+                }
+            }
+        }
+
+        // Castling, encoded as king takes own rook
+        if (genQuiets) {
+            const Square ksq = kingSq(color);
+            for (const auto side :
+                 {CastlingRights::Side::KING_SIDE, CastlingRights::Side::QUEEN_SIDE}) {
+                if (!castlingRights().has(color, side)) {
+                    continue;
+                }
+                const Square rookSq(castlingRights().getRookFile(color, side), ksq.rank());
+                if (isCastlingLegal(ksq, rookSq)) {
+                    moves.add(Move::make<Move::CASTLING>(ksq, rookSq));
+                }
+            }
+        }
+    }
+
+    /**
+     * Own pieces pinned to the own king. Computed once per node, this makes
+     * most legality checks of pseudo-legal moves trivial.
+     */
+    Bitboard pinnedPieces() const {
+        const Color    color  = sideToMove();
+        const Square   ksq    = kingSq(color);
+        const Bitboard queens = pieces(TYPE_QUEEN, ~color);
+        Bitboard       snipers =
+            (attacks::bishop(ksq, Bitboard(0)) & (pieces(TYPE_BISHOP, ~color) | queens)) |
+            (attacks::rook(ksq, Bitboard(0)) & (pieces(TYPE_ROOK, ~color) | queens));
+        Bitboard pinned = Bitboard(0);
+        while (snipers) {
+            const Square   sniper   = snipers.pop();
+            const Bitboard blockers = movegen::between(ksq, sniper) & occ() &
+                                      ~Bitboard::fromSquare(sniper);
+            if (blockers.count() == 1 && (blockers & us(color))) {
+                pinned |= blockers;
+            }
+        }
+        return pinned;
+    }
+
+    /**
+     * Check if a pseudo-legal move is legal, given the pinned pieces of this
+     * position. The side to move must not be in check.
+     */
+    bool isLegalGivenPins(const Move move, const Bitboard pinned) const {
+        const Square from = move.from();
+        const Square to   = move.to();
+        if (move.typeOf() == Move::CASTLING) {
+            return true;
+        }
+        if (move.typeOf() == Move::ENPASSANT || at(from).type() == TYPE_KING) {
+            return !leavesKingAttacked(move);
+        }
+        if (!pinned.check(from.index())) {
+            return true;
+        }
+        // A pinned piece may only move along the line to its king
+        const Square ksq = kingSq(sideToMove());
+        return movegen::between(ksq, from).check(to.index()) ||
+               movegen::between(ksq, to).check(from.index());
+    }
+
     const Movelist generateCaptureMoves() const {
         Movelist moves;
         movegen::legalmoves<movegen::MoveGenType::CAPTURE>(moves, *this);
@@ -53,29 +422,51 @@ public:
     }
 
     /**
-     * Gets the bitboard of attacked squares for a specific piece type and color
-     */
-    template <PieceType::underlying pt>
-    Bitboard getAttackMap(const Color color) {
-        Bitboard bb;
-        Bitboard pc = pieces(PieceType(pt), color);
-        while (pc) {
-            const Square sq = pc.pop();
-            if (pt == TYPE_PAWN) {
-                bb |= attacks::pawn(color, sq);
-            } else if (pt == TYPE_KNIGHT) {
-                bb |= attacks::knight(sq);
-            } else if (pt == TYPE_BISHOP) {
-                bb |= attacks::bishop(sq, occ());
-            } else if (pt == TYPE_ROOK) {
-                bb |= attacks::rook(sq, occ());
-            } else if (pt == TYPE_QUEEN) {
-                bb |= attacks::bishop(sq, occ()) | attacks::rook(sq, occ());
-            } else if (pt == TYPE_KING) {
-                bb |= attacks::king(sq);
+     * Gets the bitboards of squares attacked by the pieces of a color, by
+     * piece type, in a single pass over the pieces.
+     */
+    AttackMaps attackMaps(const Color color) const {
+        AttackMaps     maps;
+        const Bitboard pawns = pieces(TYPE_PAWN, color);
+        if (color == WHITE) {
+            maps.byType[(int) TYPE_PAWN] = attacks::pawnLeftAttacks<WHITE>(pawns) |
+                                           attacks::pawnRightAttacks<WHITE>(pawns);
+        } else {
+            maps.byType[(int) TYPE_PAWN] = attacks::pawnLeftAttacks<BLACK>(pawns) |
+                                           attacks::pawnRightAttacks<BLACK>(pawns);
+        }
+        for (PieceType pt : {TYPE_KNIGHT, TYPE_BISHOP, TYPE_ROOK, TYPE_QUEEN, TYPE_KING}) {
+            Bitboard bb = Bitboard(0);
+            Bitboard pc = pieces(pt, color);
+            while (pc) {
+                bb |= pieceAttacks(pt, pc.pop());
             }
+            maps.byType[(int) pt] = bb;
+        }
+        maps.all = maps.byType[0] | maps.byType[1] | maps.byType[2] | maps.byType[3] |
+                   maps.byType[4] | maps.byType[5];
+        return maps;
+    }
+
+    /**
+     * Gets the squares from which a piece of the given type of the side to
+     * move would directly attack the opponent king.
+     */
+    Bitboard checkSquares(const PieceType pt) const {
+        const Color  them = ~sideToMove();
+        const Square ksq  = kingSq(them);
+        if (pt == TYPE_PAWN) {
+            return attacks::pawn(them, ksq);
+        } else if (pt == TYPE_KNIGHT) {
+            return attacks::knight(ksq);
+        } else if (pt == TYPE_BISHOP) {
+            return attacks::bishop(ksq, occ());
+        } else if (pt == TYPE_ROOK) {
+            return attacks::rook(ksq, occ());
+        } else if (pt == TYPE_QUEEN) {
+            return attacks::bishop(ksq, occ()) | attacks::rook(ksq, occ());
         }
-        return bb;
+        return Bitboard(0); // the king never gives check by itself
     }
 
     int countPieces(const chess::PieceType type) const { return pieces(type).count(); }
@@ -93,120 +484,423 @@ public:
     }
 
     /**
-     * Static Exchange Evaluation.
-     *
-     * This is useful to check if a series of captures is good without
-     * explicitly playing the moves. This helps improve move ordering and
-     * skipping certain moves in search.
-     *
-     * @returns true if the move wins material after exchange sequence
+     * Hash of the pawn structure of both sides, updated incrementally.
      */
-    bool see(const Move move, int threshold) {
-        const Square    from       = move.from();
-        const Square    to         = move.to();
-        const auto      moveType   = move.typeOf();
-        const PieceType fromType   = at<PieceType>(from);
-        const PieceType toType     = moveType == Move::ENPASSANT ? TYPE_PAWN : at<PieceType>(to);
-        PieceType       nextVictim = moveType == Move::PROMOTION ? move.promotionType() : fromType;
+    uint64_t pawnKey() const { return pawnKey_; }
 
-        int balance = -threshold;
-        balance += toType != PieceType::NONE ? SEE_PIECE_VALUE[(int) toType] : 0;
-        if (moveType == Move::PROMOTION) {
-            balance += SEE_PIECE_VALUE[(int) move.promotionType()] - SEE_PIECE_VALUE[0];
+    /**
+     * Hash of the placement of the pieces other than pawns of one side,
+     * updated incrementally.
+     */
+    uint64_t nonPawnKey(const Color color) const { return nonPawnKey_[static_cast<int>(color)]; }
+
+    /**
+     * Hash of the material configuration, i.e. the piece counts of both
+     * sides, updated incrementally.
+     */
+    uint64_t materialKey() const { return materialKey_; }
+
+    /**
+     * Exact static exchange evaluation of a move, i.e. the material the side
+     * to move wins (or loses, if negative) with best play in the exchange
+     * sequence on the target square. Pins are not taken into account.
+     */
+    int seeValue(const Move move) const {
+        return seeValue(move, attackersTo(move.to(), occ()));
+    }
+
+    /**
+     * Exact static exchange evaluation of a move, given the attack maps of
+     * the opponent. A move to a square the opponent does not attack wins
+     * the captured piece outright, unless an opponent slider behind the
+     * moved piece joins in.
+     */
+    int seeValue(const Move move, const AttackMaps& threats) const {
+        const Square from = move.from();
+        const Square to   = move.to();
+        if (move.typeOf() != Move::NORMAL || threats.all.check(to.index())) {
+            return seeValue(move);
+        }
+        const Color    them     = ~sideToMove();
+        const Bitboard queens   = pieces(TYPE_QUEEN, them);
+        const Bitboard occupied = occ() ^ Bitboard::fromSquare(from);
+        if ((from.diagonal_of() == to.diagonal_of() ||
+             from.antidiagonal_of() == to.antidiagonal_of()) &&
+            (attacks::bishop(to, occupied) & (pieces(TYPE_BISHOP, them) | queens))) {
+            return seeValue(move);
+        }
+        if ((from.file() == to.file() || from.rank() == to.rank()) &&
+            (attacks::rook(to, occupied) & (pieces(TYPE_ROOK, them) | queens))) {
+            return seeValue(move);
+        }
+        return SEE_PIECE_VALUE[(int) at<PieceType>(to)];
+    }
+
+    /**
+     * Exact static exchange evaluation of all moves of a list, written to
+     * `values` in the same order. The attackers of every target square are
+     * computed only once and shared by all moves to that square.
+     */
+    void seeValues(const Movelist& moves, int* values) const {
+        std::uint64_t attackers[64]; // only valid for squares in `known`
+        Bitboard      known = Bitboard(0);
+        for (int i = 0; i < moves.size(); ++i) {
+            const Square to = moves[i].to();
+            if (!known.check(to.index())) {
+                attackers[to.index()] = attackersTo(to, occ()).getBits();
+                known |= Bitboard::fromSquare(to);
+            }
+            values[i] = seeValue(moves[i], Bitboard(attackers[to.index()]));
         }
+    }
+
+    /**
+     * Check for draw by repetition, insufficient material, or fifty-move rule.
+     */
+    bool isDraw() const { //
+        return isHalfMoveDraw() || isInsufficientMaterial() || isRepetition();
+    }
+
+    /**
+     * Check for draw in search, at `ply` from the root.
+     */
+    bool isDraw(const int ply) const {
+        return isHalfMoveDraw() || isInsufficientMaterial() || isRepetitionInSearch(ply);
+    }
 
-        // Best case fails to beat threshold
-        if (balance < 0) {
+    /**
+     * Check if a move taken from elsewhere, e.g. the TT or the killer table,
+     * can be played in this position. Whether it leaves the own king in check
+     * is not verified, except for castling. This only uses attack tables, so
+     * it is much cheaper than generating the moves.
+     */
+    bool isPseudoLegal(const Move move) const {
+        if (!move.isValid() || move == Move::NULL_MOVE) {
+            return false;
+        }
+        const Color  color = sideToMove();
+        const Square from  = move.from();
+        const Square to    = move.to();
+        const Piece  piece = at(from);
+        if (piece == Piece::NONE || piece.color() != color) {
+            return false;
+        }
+        const PieceType pt       = piece.type();
+        const auto      moveType = move.typeOf();
+        // Only promotions use the promotion bits, other moves leave them 0
+        if (moveType != Move::PROMOTION && ((move.move() >> 12) & 3) != 0) {
             return false;
         }
 
-        balance -= SEE_PIECE_VALUE[(int) nextVictim];
-        if (balance >= 0) { // Guaranteed to beat the threshold if the balance
-                            // is still positive even after the exchange
-            return true;
+        if (moveType == Move::CASTLING) {
+            return isCastlingLegal(from, to);
+        }
+        // The king is never captured, and neither are own pieces
+        if (us(color).check(to.index()) || at(to).type() == TYPE_KING) {
+            return false;
         }
 
-        Bitboard diagPieces = pieces(TYPE_BISHOP) | pieces(TYPE_QUEEN);
-        Bitboard orthPieces = pieces(TYPE_ROOK) | pieces(TYPE_QUEEN);
-        Bitboard occupied   = occ();
+        if (pt != TYPE_PAWN) {
+            if (moveType != Move::NORMAL) {
+                return false;
+            }
+            return pieceAttacks(pt, from).check(to.index());
+        }
 
-        // Suppose that move was actually made
-        occupied = occupied ^ Bitboard::fromSquare(from) ^ Bitboard::fromSquare(to);
+        // Pawns move to the last rank only by promotion
+        const bool toLastRank = to.relative_square(color).rank() == chess::Rank::RANK_8;
+        if (toLastRank != (moveType == Move::PROMOTION)) {
+            return false;
+        }
         if (moveType == Move::ENPASSANT) {
-            occupied &= ~Bitboard::fromSquare(enpassantSq());
+            return to == enpassantSq() && attacks::pawn(color, from).check(to.index());
+        }
+        if (attacks::pawn(color, from).check(to.index())) {
+            return at(to) != Piece::NONE; // diagonal moves must capture
+        }
+        const int    forward = color == WHITE ? 8 : -8;
+        const Square push    = Square(from.index() + forward);
+        if (at(push) != Piece::NONE) {
+            return false;
+        }
+        if (to == push) {
+            return true;
         }
+        return from.relative_square(color).rank() == chess::Rank::RANK_2 &&
+               to == Square(push.index() + forward) && at(to) == Piece::NONE;
+    }
 
-        // Get all attackers to that square
-        Bitboard attackers = attacks::attackers(*this, WHITE, to, occupied) |
-                             attacks::attackers(*this, BLACK, to, occupied);
-        attackers &= occupied;
+    /**
+     * Check if a move is actually legal. Moves from the move generator are
+     * legal already; this is for moves taken from elsewhere. The move type
+     * restricts the moves accepted in the same way as in move generation.
+     */
+    template <movegen::MoveGenType mt = movegen::MoveGenType::ALL>
+    bool isLegal(const Move& move) const {
+        if (!isPseudoLegal(move)) {
+            return false;
+        }
+        if (mt == movegen::MoveGenType::CAPTURE && !isCapture(move)) {
+            return false;
+        }
+        if (mt == movegen::MoveGenType::QUIET && isCapture(move)) {
+            return false;
+        }
+        return move.typeOf() == Move::CASTLING || !leavesKingAttacked(move);
+    }
 
-        Color color = ~this->sideToMove();
+private:
+    /**
+     * Attacks of a non-pawn piece from a square on the current board.
+     */
+    Bitboard pieceAttacks(const PieceType pt, const Square sq) const {
+        if (pt == TYPE_KNIGHT) {
+            return attacks::knight(sq);
+        } else if (pt == TYPE_BISHOP) {
+            return attacks::bishop(sq, occ());
+        } else if (pt == TYPE_ROOK) {
+            return attacks::rook(sq, occ());
+        } else if (pt == TYPE_QUEEN) {
+            return attacks::queen(sq, occ());
+        }
+        return attacks::king(sq);
+    }
 
-        while (true) {
-            // If we have no more attackers, we lose material
-            Bitboard myAttackers = attackers & us(color);
+    /**
+     * Pieces of both sides attacking a square, given the occupancy.
+     */
+    Bitboard attackersTo(const Square sq, const Bitboard occupied) const {
+        const Bitboard queens = pieces(TYPE_QUEEN);
+        return ((attacks::pawn(BLACK, sq) & pieces(TYPE_PAWN, WHITE)) |
+                (attacks::pawn(WHITE, sq) & pieces(TYPE_PAWN, BLACK)) |
+                (attacks::knight(sq) & pieces(TYPE_KNIGHT)) |
+                (attacks::bishop(sq, occupied) & (pieces(TYPE_BISHOP) | queens)) |
+                (attacks::rook(sq, occupied) & (pieces(TYPE_ROOK) | queens)) |
+                (attacks::king(sq) & pieces(TYPE_KING))) &
+               occupied;
+    }
+
+    /**
+     * Exact static exchange evaluation of a move, given the attackers of
+     * its target square on the current board. The exchange is played out
+     * with the least valuable attacker of each side, then the gains are
+     * folded back from the end, as each side may stop capturing.
+     */
+    int seeValue(const Move move, Bitboard attackers) const {
+        const Square    from     = move.from();
+        const Square    to       = move.to();
+        const auto      moveType = move.typeOf();
+        const PieceType toType   = moveType == Move::ENPASSANT ? TYPE_PAWN : at<PieceType>(to);
+        PieceType       onSquare = moveType == Move::PROMOTION ? move.promotionType()
+                                                                : at<PieceType>(from);
+
+        int gain[32];
+        gain[0] = SEE_PIECE_VALUE[(int) toType];
+        if (moveType == Move::PROMOTION) {
+            gain[0] += SEE_PIECE_VALUE[(int) onSquare] - SEE_PIECE_VALUE[0];
+        }
+
+        const Bitboard diagPieces = pieces(TYPE_BISHOP) | pieces(TYPE_QUEEN);
+        const Bitboard orthPieces = pieces(TYPE_ROOK) | pieces(TYPE_QUEEN);
+        Bitboard       occupied   = occ() ^ Bitboard::fromSquare(from);
+        if (moveType == Move::ENPASSANT) {
+            occupied ^= Bitboard::fromSquare(to.ep_square());
+        }
+        // Sliders behind the moved piece, or behind a pawn captured en
+        // passant, join in. Only the lines actually cleared are looked up.
+        if (from.diagonal_of() == to.diagonal_of() ||
+            from.antidiagonal_of() == to.antidiagonal_of()) {
+            attackers |= attacks::bishop(to, occupied) & diagPieces;
+        }
+        if (from.file() == to.file() || from.rank() == to.rank() || moveType == Move::ENPASSANT) {
+            attackers |= attacks::rook(to, occupied) & orthPieces;
+        }
+        attackers &= occupied;
+
+        Color color = ~sideToMove();
+        int   d     = 0;
+        while (d < 31) {
+            const Bitboard myAttackers = attackers & us(color);
             if (myAttackers.empty()) {
                 break;
             }
-
-            // Find least valuable attacker
+            // Capture with the least valuable attacker
+            PieceType attacker = TYPE_PAWN;
             for (PieceType pt :
                  {TYPE_PAWN, TYPE_KNIGHT, TYPE_BISHOP, TYPE_ROOK, TYPE_QUEEN, TYPE_KING}) {
-                nextVictim = pt;
-                if (attackers & pieces(pt, color)) {
+                attacker = pt;
+                if (myAttackers & pieces(pt)) {
                     break;
                 }
             }
+            ++d;
+            gain[d] = SEE_PIECE_VALUE[(int) onSquare] - gain[d - 1];
 
-            // Remove this attacker from the occupied bitboard
-            occupied &=
-                ~Bitboard::fromSquare(Square((myAttackers & pieces(nextVictim, color)).lsb()));
-
-            if (nextVictim == TYPE_PAWN || nextVictim == TYPE_BISHOP || nextVictim == TYPE_QUEEN) {
-                attackers |= (attacks::bishop(to, occupied) & diagPieces);
+            occupied ^= Bitboard::fromSquare(Square((myAttackers & pieces(attacker)).lsb()));
+            if (attacker == TYPE_PAWN || attacker == TYPE_BISHOP || attacker == TYPE_QUEEN) {
+                attackers |= attacks::bishop(to, occupied) & diagPieces;
             }
-            if (nextVictim == TYPE_ROOK || nextVictim == TYPE_QUEEN) {
-                attackers |= (attacks::rook(to, occupied) & orthPieces);
+            if (attacker == TYPE_ROOK || attacker == TYPE_QUEEN) {
+                attackers |= attacks::rook(to, occupied) & orthPieces;
             }
-
             attackers &= occupied;
-            color   = ~color;
-            balance = -balance - 1 - SEE_PIECE_VALUE[(int) nextVictim];
-
-            if (balance >= 0) { // We win material if the balance is
-                                // non-negative after the exchanges
-                if (nextVictim == TYPE_KING && (attackers & us(color))) {
-                    // If we are attacking king and we still have attackers, we
-                    // still win
-                    color = ~color;
-                }
-                break;
+            onSquare = attacker;
+            color    = ~color;
+        }
+
+        while (d > 0) {
+            gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+            --d;
+        }
+        return gain[0];
+    }
+
+    /**
+     * Check if a pseudo-legal move leaves the own king attacked, by looking
+     * for attackers on the occupancy after the move.
+     */
+    bool leavesKingAttacked(const Move move) const {
+        const Color  color    = sideToMove();
+        const Square from     = move.from();
+        const Square to       = move.to();
+        Bitboard     occupied = (occ() ^ Bitboard::fromSquare(from)) | Bitboard::fromSquare(to);
+        if (move.typeOf() == Move::ENPASSANT) {
+            occupied ^= Bitboard::fromSquare(to.ep_square());
+        }
+        const Square king = at(from).type() == TYPE_KING ? to : kingSq(color);
+        // A captured piece on the target square does not attack anymore
+        const Bitboard attackers = attacks::attackers(*this, ~color, king, occupied);
+        return (attackers & ~Bitboard::fromSquare(to)) != 0;
+    }
+
+    /**
+     * Check if a castling move, encoded as king takes own rook, is legal.
+     */
+    bool isCastlingLegal(const Square from, const Square to) const {
+        const Color color = sideToMove();
+        if (at(from).type() != TYPE_KING || at(to) != Piece(TYPE_ROOK, color) || inCheck()) {
+            return false;
+        }
+        const bool kingSide = to.index() > from.index();
+        const auto side     = kingSide ? CastlingRights::Side::KING_SIDE
+                                       : CastlingRights::Side::QUEEN_SIDE;
+        if (!castlingRights().has(color, side) ||
+            castlingRights().getRookFile(color, side) != to.file() || to.rank() != from.rank()) {
+            return false;
+        }
+        if (occ() & getCastlingPath(color, kingSide)) {
+            return false;
+        }
+        // The king may not pass through or land on an attacked square
+        Bitboard kingPath = movegen::between(from, Square::castling_king_square(kingSide, color));
+        while (kingPath) {
+            if (isAttacked(kingPath.pop(), ~color)) {
+                return false;
             }
         }
+        return true;
+    }
 
-        return sideToMove() != color;
+    void saveState(PositionState& state) const {
+        state.pieces        = pieces_bb_;
+        state.occupancy     = occ_bb_;
+        state.board         = board_;
+        state.key           = key_;
+        state.castling      = cr_;
+        state.plies         = plies_;
+        state.sideToMove    = stm_;
+        state.epSquare      = ep_sq_;
+        state.halfMoveClock = hfm_;
+        state.keyCount      = keyCount;
+        state.pliesFromNull = pliesFromNull;
+        state.pawnKey       = pawnKey_;
+        state.nonPawnKey[0] = nonPawnKey_[0];
+        state.nonPawnKey[1] = nonPawnKey_[1];
+        state.materialKey   = materialKey_;
     }
 
     /**
-     * Check for draw by repetition, insufficient material, or fifty-move rule.
+     * Append the current key to the key history. Only game moves compact the
+     * history, since copy-make restores the length but not the keys. The
+     * search, perft and movebench go at most MAX_PLY plies deeper than the
+     * game position, so a full history is a bug.
      */
-    bool isDraw() const { //
-        return isHalfMoveDraw() || isInsufficientMaterial() || isRepetition();
+    void pushKey() {
+        assert(keyCount < KEY_HISTORY_SIZE);
+        keyHistory[keyCount++] = key_;
     }
 
     /**
-     * Check if a move is actually legal. So far we have no good solutions
-     * except for checking if the move is in the legal move list.
+     * The keys and piece hooks are never called with Piece::NONE. The hint
+     * keeps the compiler from assuming they are, and warning about the tables
+     * they index, in builds without assertions as well.
      */
-    template <movegen::MoveGenType mt = movegen::MoveGenType::ALL>
-    bool isLegal(const Move& move) const {
-        const auto pt = at(move.from()).type();
-        Movelist   moves;
-        movegen::legalmoves<mt>(moves, *this, 1 << (int) pt);
-        return std::find(moves.begin(), moves.end(), move) != moves.end();
+    static void assertPiece(const Piece piece) {
+        assert(piece != Piece::NONE);
+        if (piece == Piece::NONE) __builtin_unreachable();
+    }
+
+    /**
+     * Toggle `piece` on `sq` in the pawn or non-pawn key, and the `count`-th
+     * piece of its kind in the material key.
+     */
+    void toggleKeys(const Piece piece, const Square sq, const int count) {
+        assertPiece(piece);
+        const int      p   = static_cast<int>(piece);
+        const uint64_t key = PIECE_SQUARE_KEYS[p][sq.index()];
+        if (piece.type() == PieceType::PAWN) {
+            pawnKey_ ^= key;
+        } else {
+            nonPawnKey_[p / 6] ^= key;
+        }
+        materialKey_ ^= MATERIAL_KEYS[p][count];
     }
 
+    /**
+     * Compute the incremental keys from scratch. Board sets up a position
+     * without going through the piece hooks, so this runs after each FEN.
+     */
+    void refreshKeys() {
+        pawnKey_ = materialKey_ = nonPawnKey_[0] = nonPawnKey_[1] = 0;
+
+        int      counts[12] = {};
+        Bitboard occupied   = occ();
+        while (occupied) {
+            const Square sq    = occupied.pop();
+            const Piece  piece = board_[sq.index()];
+            toggleKeys(piece, sq, counts[static_cast<int>(piece)]++);
+        }
+    }
+
+protected:
+    // Board routes every piece change of makeMove and unmakeMove through
+    // these hooks, which keep the incremental keys up to date.
+    void placePiece(Piece piece, Square sq) override {
+        assertPiece(piece);
+        toggleKeys(piece, sq, pieces(piece.type(), piece.color()).count());
+        Board::placePiece(piece, sq);
+    }
+
+    void removePiece(Piece piece, Square sq) override {
+        assertPiece(piece);
+        Board::removePiece(piece, sq);
+        toggleKeys(piece, sq, pieces(piece.type(), piece.color()).count());
+    }
+
+private:
+
+    // Keys of the positions before the current one, for repetition
+    // detection. A fixed array, unlike the previous-state stack of Board.
+    static constexpr int KEY_HISTORY_SIZE = 512;
+
+    std::array<uint64_t, KEY_HISTORY_SIZE> keyHistory;
+    int                                    keyCount      = 0;
+    int                                    pliesFromNull = 0;
+
+    uint64_t pawnKey_       = 0;
+    uint64_t nonPawnKey_[2] = {};
+    uint64_t materialKey_   = 0;
+
 public:
     /**
      * Yet another way to quick access the board
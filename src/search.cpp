@@ -5,7 +5,9 @@
 #include "timecontrol.h"
 #include "tt.h"
 #include "types.h"
+#include "ucioption.h"
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <iostream>
@@ -20,6 +22,13 @@
 std::atomic<bool> g_stopRequested(false);
 TimeControl       g_timeControl;
 
+/**
+ * Global flag to signal that the opponent has played the move we are
+ * pondering on. The search thread picks it up and switches to normal
+ * time control without restarting the search.
+ */
+std::atomic<bool> g_ponderHit(false);
+
 namespace {
 
 /**
@@ -34,14 +43,58 @@ struct SearchStats {
  * Entry in the search stack.
  */
 struct SearchStackEntry {
-    Value staticEval = VALUE_NONE;
-    Move  bestMove;
-    Move  excludedMove;
-    bool  inCheck     = false;
-    bool  canNullMove = true;
+    Value staticEval   = VALUE_NONE;
+    Move  bestMove     = Move::NO_MOVE;
+    Move  excludedMove = Move::NO_MOVE; // skipped in singular extension search
+    Move  move         = Move::NO_MOVE; // move played from this node, NO_MOVE for null move
+    Piece movedPiece   = Piece::NONE;   // piece of that move, for continuation history
+    bool  inCheck      = false;
+    bool  canNullMove  = true;
+
+    ThreatCache threats; // opponent attack maps of the node
 };
 using SearchStack = std::array<SearchStackEntry, MAX_PLY>;
 
+/**
+ * A legal move at the root, together with the statistics collected while
+ * searching it. These are used to order the root moves for the next
+ * iteration.
+ */
+struct RootMove {
+    Move              move;
+    Value             score         = MATED_VALUE; // score of the last completed search
+    Value             previousScore = MATED_VALUE; // score of the iteration before that
+    uint64_t          nodes         = 0;           // size of the subtree in the last iteration
+    int               selDepth      = 0;
+    std::vector<Move> pv;                          // principal variation starting with `move`
+
+    explicit RootMove(const Move m) : move(m) {}
+};
+using RootMoves = std::vector<RootMove>;
+
+/**
+ * Triangular principal variation table. Row `ply` holds the best line found
+ * from that ply on. It is rebuilt from the row below whenever a move raises
+ * alpha at a PV node, so the PV is always complete and never depends on
+ * transposition table entries surviving.
+ */
+struct PvTable {
+    Move moves[MAX_PLY + 1][MAX_PLY + 1];
+    int  length[MAX_PLY + 1];
+
+    void clear(int ply) { length[ply] = 0; }
+    void update(int ply, const Move m) {
+        moves[ply][0] = m;
+        for (int i = 0; i < length[ply + 1]; ++i) {
+            moves[ply][i + 1] = moves[ply + 1][i];
+        }
+        length[ply] = length[ply + 1] + 1;
+    }
+};
+
+// Only report the move currently searched at the root after this many milliseconds
+constexpr int CURRMOVE_REPORT_TIME = 3000;
+
 std::thread searchThread;
 
 // LMR Table ============================================================================
@@ -55,35 +108,176 @@ void   computeLMRTable() {
     }
 }
 
+// Search parameters ====================================================================
+// Internal iterative reductions: minimum depth and depth reduction at PV and
+// cut nodes without a transposition table move
+constexpr int IIR_MIN_DEPTH = 4;
+constexpr int IIR_REDUCTION = 1;
+
+// ProbCut: minimum depth, margin over beta and depth reduction of the
+// verification search
+constexpr int PROBCUT_MIN_DEPTH = 5;
+constexpr int PROBCUT_MARGIN    = 200;
+constexpr int PROBCUT_REDUCTION = 4;
+
+// Late move pruning: at depth up to LMP_MAX_DEPTH, quiet moves are skipped
+// after (LMP_BASE + depth^2) moves, half as many when not improving
+constexpr int LMP_MAX_DEPTH = 8;
+constexpr int LMP_BASE      = 3;
+
+// Futility pruning: at depth up to FUTILITY_MAX_DEPTH, the remaining quiet
+// moves are skipped when the static evaluation plus FUTILITY_BASE +
+// FUTILITY_MARGIN * depth is below alpha. The margin is one depth larger when
+// improving.
+constexpr int FUTILITY_MAX_DEPTH = 8;
+constexpr int FUTILITY_BASE      = 150;
+constexpr int FUTILITY_MARGIN    = 100;
+
+// History pruning: at depth up to HISTORY_PRUNING_MAX_DEPTH, quiet moves with
+// a history score below -HISTORY_PRUNING_MARGIN * depth are skipped
+constexpr int HISTORY_PRUNING_MAX_DEPTH = 4;
+constexpr int HISTORY_PRUNING_MARGIN    = 2000;
+
+// SEE pruning: at depth up to SEE_PRUNING_MAX_DEPTH, moves losing more than
+// SEE_QUIET_MARGIN * depth (quiets) or SEE_NOISY_MARGIN * depth^2 (captures)
+// are skipped
+constexpr int SEE_PRUNING_MAX_DEPTH = 8;
+constexpr int SEE_QUIET_MARGIN      = 60;
+constexpr int SEE_NOISY_MARGIN      = 25;
+
+// Depth of qsearch results stored in the TT, below any main search depth.
+// Results of the first qsearch ply, which includes quiet checks, rank higher.
+constexpr int QSEARCH_CHECKS_TT_DEPTH = 0;
+constexpr int QSEARCH_TT_DEPTH        = -1;
+
+// Delta pruning: qsearch moves are skipped if the static eval plus their
+// exact SEE value and this margin stays below alpha
+constexpr int QSEARCH_DELTA_MARGIN = 200;
+
 // Global variables =====================================================================
 SearchStats   searchStats;
 SearchStack   searchStack;
 SearchHistory searchHistory;
 
-std::vector<Move> extractPv(Position pos, int maxDepth = 64) {
-    std::vector<Move> pv;
-    pv.reserve(maxDepth);
+PvTable       pvTable;
 
-    for (int d = 0; d < maxDepth; ++d) {
-        TTEntry* e = tt.probe(pos);
-        if (!e || !e->hasInitialized() || e->zobrist != pos.hash() || e->type != EntryType::EXACT)
-            break;
+/**
+ * Continuation history entry of the move played `back` plies before `ply`.
+ * Before the root this is the entry of `Piece::NONE`, which is never updated.
+ */
+ContinuationHistoryEntry* getContHist(int ply, int back) {
+    if (ply < back) {
+        return &searchHistory.contHistory[back - 1].at(Piece::NONE, Square(0));
+    }
+    const SearchStackEntry& ss = searchStack[ply - back];
+    return &searchHistory.contHistory[back - 1].at(ss.movedPiece, ss.move.to());
+}
 
-        // Testing platform is unhappy about moves after repetition
-        if (pos.isRepetition())
-            break;
+/**
+ * Update the butterfly and continuation history of a quiet move.
+ */
+void updateQuietHistory(Position& pos, int ply, const Move move, int16_t bonus) {
+    const Piece piece = pos.at(move.from());
+    searchHistory.qHistoryTable.update(pos.sideToMove(), move, bonus);
+    for (int back = 1; back <= 2; ++back) {
+        if (ply >= back && searchStack[ply - back].movedPiece != Piece::NONE) {
+            getContHist(ply, back)->update(piece, move.to(), bonus);
+        }
+    }
+}
 
-        Move m = e->move();
-        if (m.move() == 0 || !pos.isLegal(m))
-            break;
-        pv.push_back(m);
-        pos.makeMove(m);
+/**
+ * Update the move ordering tables on a beta cutoff. The move causing the
+ * cutoff is rewarded, and the moves searched before it are penalized by the
+ * same amount, so that history scores tell good and bad moves apart quickly.
+ */
+void updateCutoffHistories(
+    Position&   pos,
+    int         ply,
+    int         depth,
+    const Move  bestMove,
+    const Move* quietsSearched,
+    int         quietCount,
+    const Move* capturesSearched,
+    int         captureCount) {
+    const int16_t bonus = std::min(depth * depth, (int) MAX_HISTORY_SCORE);
+
+    if (!pos.isCapture(bestMove)) {
+        searchHistory.killerTable[ply].add(bestMove);
+        if (ply > 0 && searchStack[ply - 1].movedPiece != Piece::NONE) {
+            const SearchStackEntry& prevSS = searchStack[ply - 1];
+            searchHistory.counterMoveTable.set(prevSS.movedPiece, prevSS.move.to(), bestMove);
+        }
+        updateQuietHistory(pos, ply, bestMove, bonus);
+        for (int i = 0; i < quietCount; ++i) {
+            updateQuietHistory(pos, ply, quietsSearched[i], -bonus);
+        }
+    } else {
+        searchHistory.capHistoryTable.update(pos.sideToMove(), bestMove, pos, bonus);
+    }
+    for (int i = 0; i < captureCount; ++i) {
+        searchHistory.capHistoryTable.update(pos.sideToMove(), capturesSearched[i], pos, -bonus);
+    }
+}
+
+/**
+ * Adjust the raw static evaluation by the correction history of the
+ * position's pawn structure, piece placement and material.
+ */
+Value correctStaticEval(const Position& pos, const Value rawEval) {
+    const Color stm        = pos.sideToMove();
+    const int   correction = searchHistory.pawnCorrHistory.get(stm, pos.pawnKey()) +
+                           searchHistory.materialCorrHistory.get(stm, pos.materialKey()) +
+                           searchHistory.nonPawnCorrHistory[0].get(stm, pos.nonPawnKey(WHITE)) +
+                           searchHistory.nonPawnCorrHistory[1].get(stm, pos.nonPawnKey(BLACK));
+    // Each table holds at most 1024, so the correction stays within 256cp
+    return std::clamp(rawEval.value() + correction / 16,
+                      -MATE_VALUE_THRESHOLD + 1,
+                      MATE_VALUE_THRESHOLD - 1);
+}
+
+/**
+ * Train the correction history with the difference between the search
+ * result and the static evaluation of a position.
+ */
+void updateCorrectionHistory(const Position& pos, int depth, Value bestScore, Value staticEval) {
+    const Color stm   = pos.sideToMove();
+    const int   bonus = (bestScore - staticEval).value() * depth / 8;
+    searchHistory.pawnCorrHistory.update(stm, pos.pawnKey(), bonus);
+    searchHistory.materialCorrHistory.update(stm, pos.materialKey(), bonus);
+    searchHistory.nonPawnCorrHistory[0].update(stm, pos.nonPawnKey(WHITE), bonus);
+    searchHistory.nonPawnCorrHistory[1].update(stm, pos.nonPawnKey(BLACK), bonus);
+}
+
+// Depth of the current iteration
+int rootDepth = 0;
+
+// Whether selective pruning and reductions are enabled. Disabled in strict
+// mate search, as they may hide mates.
+bool allowPruning = true;
+
+/**
+ * Check if the search must be aborted immediately, either on a stop request
+ * or when the hard limit is hit. This is also where a ponderhit is handed
+ * over to the time control.
+ */
+bool searchAborted(int depth) {
+    if (g_stopRequested.load()) {
+        return true;
+    }
+    if (g_timeControl.pondering && g_ponderHit.load()) {
+        g_timeControl.ponderhit(TimeControl::now());
     }
-    return pv;
+    return g_timeControl.hitHardLimit(depth, searchStats.nodes);
 }
 
 /**
  * Quiescence search. Search for quiet positions to yield a better evaluation.
+ *
+ * `depth` is 0 at the first qsearch ply, where quiet checks are searched as
+ * well, and negative below. There is no depth limit: captures run out
+ * eventually, and cycles of checks and evasions are cut by repetition
+ * detection and the TT.
  */
 Value qsearch(Position& pos, int depth, int ply, Value alpha, Value beta) {
     // Exit immediately on stop requests only
@@ -94,26 +288,70 @@ Value qsearch(Position& pos, int depth, int ply, Value alpha, Value beta) {
     searchStats.nodes++;
     searchStats.selDepth = std::max(searchStats.selDepth, ply);
     // Draw detection
-    if (pos.isDraw()) {
+    if (pos.isDraw(ply)) {
         return DRAW_VALUE;
     }
+    if (alpha < DRAW_VALUE && pos.hasUpcomingRepetition(ply)) {
+        alpha = DRAW_VALUE;
+        if (alpha >= beta) {
+            return alpha;
+        }
+    }
 
-    Value standPat  = evaluate(pos);
-    Value bestScore = standPat;
-
-    // Force stop on maximum depth
-    if (depth <= 0) {
-        return standPat;
+    const bool inCheck = pos.inCheck();
+    if (ply >= MAX_PLY - 1) {
+        return inCheck ? DRAW_VALUE : evaluate(pos);
     }
-    // Early pruning
-    if (bestScore >= beta) {
-        return bestScore;
+
+    // Transposition table lookup
+    // Entries of a qsearch without quiet checks are not good enough for one
+    // with them, all other entries are.
+    const int      ttStoreDepth = depth >= 0 ? QSEARCH_CHECKS_TT_DEPTH : QSEARCH_TT_DEPTH;
+    const TTEntry* ttEntry      = tt.probe(pos);
+    const bool     ttHit        = ttEntry != nullptr;
+    const uint16_t ttMoveCode   = ttHit ? ttEntry->move_code : 0;
+    const Value    ttValue      = ttHit ? ttEntry->value : VALUE_NONE;
+    const int      ttDepth      = ttHit ? ttEntry->depth : 0;
+    const auto     ttType       = ttHit ? ttEntry->type : EntryType::NONE;
+    // Do not overwrite the result of a deeper search of this position
+    const bool ttWritable = !ttHit || ttDepth <= ttStoreDepth;
+    if (ttDepth >= ttStoreDepth && ttValue.isValid() &&
+        ((ttType == EntryType::EXACT) || (ttType == EntryType::UPPER_BOUND && ttValue <= alpha) ||
+         (ttType == EntryType::LOWER_BOUND && ttValue >= beta))) {
+        return ttValue;
     }
-    if (bestScore > alpha) {
-        alpha = bestScore;
+
+    // Stand pat. When in check, every evasion has to be searched instead, and
+    // having none means being mated.
+    // Reuse the static evaluation stored in the TT if possible.
+    Value rawEval   = VALUE_NONE;
+    Value standPat  = VALUE_NONE;
+    Value bestScore = Value::matedIn(ply);
+    if (!inCheck) {
+        rawEval   = (ttHit && ttEntry->eval.isValid()) ? ttEntry->eval : evaluate(pos);
+        standPat  = rawEval;
+        bestScore = standPat;
+
+        // Early pruning
+        if (bestScore >= beta) {
+            if (!ttHit) {
+                tt.store(
+                    pos, EntryType::LOWER_BOUND, ttStoreDepth, Move::NO_MOVE, bestScore, rawEval);
+            }
+            return bestScore;
+        }
+        if (bestScore > alpha) {
+            alpha = bestScore;
+        }
     }
 
-    MovePicker mp(pos, searchHistory, ply, Move::NO_MOVE, true);
+    Move      bestMove = Move::NO_MOVE;
+    EntryType ttFlag   = EntryType::UPPER_BOUND;
+
+    MovePicker mp(pos, searchHistory, ply, ttMoveCode, true);
+    if (depth >= 0) {
+        mp.includeQuietChecks();
+    }
 
     while (true) {
         const Move m = mp.next();
@@ -121,27 +359,48 @@ Value qsearch(Position& pos, int depth, int ply, Value alpha, Value beta) {
             break;
         }
 
-        // Delta Pruning
-        Value delta = PIECE_VALUE[pos.at(m.to()).type()] + Value(200);
-        if (!pos.inCheck() && standPat + delta < alpha) {
-            continue;
+        if (!inCheck) {
+            // Delta Pruning
+            // Skip moves that cannot raise alpha even if the exchange they
+            // start goes as expected
+            const int see = mp.seeValue(m);
+            if (standPat + Value(see) + Value(QSEARCH_DELTA_MARGIN) < alpha) {
+                continue;
+            }
+            // Quiet checks that lose material are not worth it
+            if (!pos.isCapture(m) && see < 0) {
+                continue;
+            }
         }
 
-        pos.makeMove(m);
+        PositionState undo;
+        pos.makeMove(m, undo);
         Value score = -qsearch(pos, depth - 1, ply + 1, -beta, -alpha);
-        pos.unmakeMove(m);
+        pos.unmakeMove(undo);
+
+        if (g_stopRequested.load()) {
+            return alpha;
+        }
 
         if (score >= beta) {
+            if (ttWritable) {
+                tt.store(pos, EntryType::LOWER_BOUND, ttStoreDepth, m, score, rawEval);
+            }
             return score;
         }
         if (score > bestScore) {
             bestScore = score;
         }
         if (score > alpha) {
-            alpha = score;
+            alpha    = score;
+            bestMove = m;
+            ttFlag   = EntryType::EXACT;
         }
     }
 
+    if (ttWritable) {
+        tt.store(pos, ttFlag, ttStoreDepth, bestMove, bestScore, rawEval);
+    }
     return bestScore;
 }
 
@@ -156,8 +415,11 @@ Value qsearch(Position& pos, int depth, int ply, Value alpha, Value beta) {
  */
 template <bool isPV>
 Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool cutnode) {
+    if (isPV) {
+        pvTable.clear(ply);
+    }
     // Exit immediately on timeouts or stop requests
-    if (g_timeControl.hitHardLimit(depth, searchStats.nodes) || g_stopRequested.load()) {
+    if (searchAborted(depth)) {
         return alpha;
     }
 
@@ -166,15 +428,27 @@ Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool c
     const bool isRoot  = (ply == 0);
     const bool inCheck = pos.inCheck();
 
+    // Stop extending at the end of the search stack
+    if (ply >= MAX_PLY - 1) {
+        return inCheck ? DRAW_VALUE : evaluate(pos);
+    }
+
     // Quiescence search
     if (depth <= 0 && !inCheck) {
-        return qsearch(pos, 8, ply + 1, alpha, beta);
+        return qsearch(pos, 0, ply, alpha, beta);
     }
 
-    // Draw detection
-    if (ply > 0 && pos.isDraw()) {
+    // Draw detection. A reversible move back to an earlier position is a
+    // draw we can claim, so the node is worth at least a draw.
+    if (ply > 0 && pos.isDraw(ply)) {
         return DRAW_VALUE;
     }
+    if (ply > 0 && alpha < DRAW_VALUE && pos.hasUpcomingRepetition(ply)) {
+        alpha = DRAW_VALUE;
+        if (alpha >= beta) {
+            return alpha;
+        }
+    }
 
     // Mate distance pruning
     alpha = std::max(alpha, Value::matedIn(ply));
@@ -184,36 +458,38 @@ Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool c
     }
 
     // Set up working environment
-    SearchStackEntry* currSS = &searchStack[ply];
-    SearchStackEntry* prevSS = ply > 0 ? &searchStack[ply - 1] : nullptr;
-    currSS->inCheck          = inCheck;
+    SearchStackEntry* currSS       = &searchStack[ply];
+    SearchStackEntry* prevSS       = ply > 0 ? &searchStack[ply - 1] : nullptr;
+    const Move        excludedMove = currSS->excludedMove;
+    currSS->inCheck                = inCheck;
 
     searchHistory.killerTable[ply + 1].clear();
     searchStats.nodes++;
-    if (ply == 0) {
-        searchHistory.qHistoryTable.clear();
-    }
 
     // Transposition table lookup
     // See if this node has been visited before. If so, we can reuse the data
     // if this isn't a PV node; if not, we can still use part of the data.
-    const TTEntry* ttEntry         = tt.probe(pos);
+    // The entry is copied since it can be overwritten by the searches below.
+    // With an excluded move, the stored result does not apply to this search.
+    const TTEntry* ttEntry         = excludedMove.isValid() ? nullptr : tt.probe(pos);
     const bool     ttHit           = ttEntry != nullptr;
     const uint16_t ttMoveCode      = ttHit ? ttEntry->move_code : 0;
+    const Value    ttValue         = ttHit ? ttEntry->value : VALUE_NONE;
+    const int      ttDepth         = ttHit ? ttEntry->depth : 0;
+    const auto     ttType          = ttHit ? ttEntry->type : EntryType::NONE;
     const int      ttRequiredDepth = depth + (isPV ? 2 : 0);
     bool           ttPruned        = false;
-    if (!isRoot && ttHit                        // if there is an entry
-        && ttEntry->depth >= ttRequiredDepth    // with reliably high depth
-        && (ttEntry->value <= alpha || cutnode) // okay to perform beta cutoff
+    if (!isRoot && ttHit                 // if there is an entry
+        && ttDepth >= ttRequiredDepth    // with reliably high depth
+        && (ttValue <= alpha || cutnode) // okay to perform beta cutoff
     ) {
-        const auto ttType    = ttEntry->type;
-        const bool isBounded = ttEntry->value.isValid() &&
+        const bool isBounded = ttValue.isValid() &&
                                ((ttType == EntryType::EXACT) ||
-                                (ttType == EntryType::UPPER_BOUND && ttEntry->value <= alpha) ||
-                                (ttType == EntryType::LOWER_BOUND && ttEntry->value >= beta));
+                                (ttType == EntryType::UPPER_BOUND && ttValue <= alpha) ||
+                                (ttType == EntryType::LOWER_BOUND && ttValue >= beta));
         if (isBounded) {
             if (!isPV) {
-                return ttEntry->value; // in non-PV nodes we can safely return the value
+                return ttValue; // in non-PV nodes we can safely return the value
             } else {
                 depth--; // in PV nodes, reduce search depth
                 ttPruned = true;
@@ -222,14 +498,31 @@ Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool c
     }
 
     // Static evaluation
-    Value staticEval   = inCheck ? VALUE_NONE : evaluate(pos);
+    // Reuse the static evaluation stored in the TT if possible
+    const Value rawEval =
+        inCheck ? VALUE_NONE : (ttHit && ttEntry->eval.isValid() ? ttEntry->eval : evaluate(pos));
+    Value staticEval   = inCheck ? VALUE_NONE : correctStaticEval(pos, rawEval);
     currSS->staticEval = staticEval;
 
+    // Whether the static evaluation improved since our previous move. Pruning
+    // is less aggressive when it did.
+    const bool improving = !inCheck && ply >= 2 && searchStack[ply - 2].staticEval.isValid() &&
+                           staticEval > searchStack[ply - 2].staticEval;
+
+    // Internal iterative reductions
+    // Without a TT move the move ordering is poor, so a full depth search here
+    // is expensive. Search shallower instead; this also stores a move in the
+    // TT for the next iteration.
+    if ((isPV || cutnode) && depth >= IIR_MIN_DEPTH && ttMoveCode == 0 &&
+        !excludedMove.isValid() && allowPruning) {
+        depth -= IIR_REDUCTION;
+    }
+
     // Pre-move-loop pruning
 
     // If static evaluation is a fail-high or fail-low, we can likely prune
     // without doing any further work.
-    if (!isPV && !inCheck) {
+    if (!isPV && !inCheck && allowPruning && !excludedMove.isValid()) {
         // Reverse Futility Pruning
         const Value futilityMargin = Value(200) + Value(100) * depth;
         if (depth <= 9 && !alpha.isMate() && staticEval - futilityMargin > beta) {
@@ -238,22 +531,25 @@ Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool c
 
         // Razoring
         if (staticEval < alpha - Value(500) - Value(100) * depth) {
-            return qsearch(pos, depth - 1, ply + 1, alpha, beta);
+            return qsearch(pos, 0, ply, alpha, beta);
         }
 
         // Null move pruning
         if (depth >= 6                                       // enough depth
             && currSS->canNullMove                           // prev move not null move
             && staticEval >= beta                            // value is too strong
-            && (!ttHit || cutnode || ttEntry->value >= beta) //
+            && (!ttHit || cutnode || ttValue >= beta)        //
             && pos.hasNonPawnMaterial()                      // avoid zugzwang in endgame
         ) {
             int r                            = 2 + depth / 3;
             searchStack[ply + 1].canNullMove = false; // disable null move for next ply
 
-            pos.makeNullMove();
+            currSS->move       = Move::NO_MOVE;
+            currSS->movedPiece = Piece::NONE;
+            PositionState undo;
+            pos.makeNullMove(undo);
             Value score = -negamax<false>(pos, depth - r, ply + 1, -beta, -beta + 1, !cutnode);
-            pos.unmakeNullMove();
+            pos.unmakeMove(undo);
 
             searchStack[ply + 1].canNullMove = true; // restore
 
@@ -269,6 +565,46 @@ Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool c
                 }
             }
         }
+
+        // ProbCut
+        // If a good capture beats beta by a margin in a reduced search, the
+        // full depth search would very likely fail high as well. The capture
+        // is verified with qsearch first, which is much cheaper.
+        const Value probCutBeta = beta + PROBCUT_MARGIN;
+        if (depth >= PROBCUT_MIN_DEPTH && !beta.isMate() &&
+            !(ttHit && ttDepth >= depth - 3 && ttValue.isValid() && ttValue < probCutBeta)) {
+            MovePicker probCutPicker(
+                pos, searchHistory, ply, ttMoveCode, (probCutBeta - staticEval).value());
+            while (true) {
+                const Move m = probCutPicker.next();
+                if (m.move() == Move::NO_MOVE) {
+                    break;
+                }
+
+                currSS->move       = m;
+                currSS->movedPiece = pos.at(m.from());
+                PositionState undo;
+                pos.makeMove(m, undo);
+                Value score = -qsearch(pos, 0, ply + 1, -probCutBeta, -probCutBeta + 1);
+                if (score >= probCutBeta) {
+                    score = -negamax<false>(pos,
+                                            depth - PROBCUT_REDUCTION,
+                                            ply + 1,
+                                            -probCutBeta,
+                                            -probCutBeta + 1,
+                                            !cutnode);
+                }
+                pos.unmakeMove(undo);
+
+                if (searchAborted(depth)) {
+                    return alpha;
+                }
+                if (score >= probCutBeta) {
+                    tt.store(pos, EntryType::LOWER_BOUND, depth - 3, m, score, rawEval);
+                    return score;
+                }
+            }
+        }
     }
 
     Move      bestMove     = Move::NO_MOVE;
@@ -276,20 +612,103 @@ Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool c
     EntryType ttFlag       = EntryType::UPPER_BOUND;
     int       moveSearched = 0;
 
-    MovePicker mp(pos, searchHistory, ply, ttMoveCode, false);
+    // Moves searched without causing a cutoff, penalized on a later cutoff
+    Move quietsSearched[64];
+    Move capturesSearched[32];
+    int  quietCount   = 0;
+    int  captureCount = 0;
+
+    const ContinuationHistoryEntry* contHist[2] = {getContHist(ply, 1), getContHist(ply, 2)};
+    const uint16_t                  counterMove =
+        prevSS ? searchHistory.counterMoveTable.get(prevSS->movedPiece, prevSS->move.to()) : 0;
+    MovePicker mp(
+        pos, searchHistory, ply, ttMoveCode, false, contHist, counterMove, &currSS->threats);
 
     while (true) {
         Move m = mp.next();
         if (m.move() == Move::NO_MOVE) {
             break;
         }
+        if (m == excludedMove) {
+            continue;
+        }
         moveSearched++;
 
+        const bool isQuiet = !pos.isCapture(m) && m.typeOf() != Move::PROMOTION;
+        const int  historyScore =
+            isQuiet ? searchHistory.qHistoryTable.get(pos.sideToMove(), m) +
+                          contHist[0]->get(pos.at(m.from()), m.to()) +
+                          contHist[1]->get(pos.at(m.from()), m.to())
+                    : 0;
+
+        // Move loop pruning
+        // Once a move has been searched without getting mated, skip the moves
+        // that are unlikely to raise alpha. PV nodes are searched fully.
+        if (!isPV && !isRoot && !inCheck && allowPruning &&
+            bestScore > Value(-MATE_VALUE_THRESHOLD)) {
+            if (isQuiet) {
+                // Late move pruning
+                const int lmpThreshold = (LMP_BASE + depth * depth) / (improving ? 1 : 2);
+                if (depth <= LMP_MAX_DEPTH && moveSearched > lmpThreshold) {
+                    mp.skipQuiet();
+                    continue;
+                }
+                // Futility pruning
+                const int futilityMargin = FUTILITY_BASE + FUTILITY_MARGIN * (depth + improving);
+                if (depth <= FUTILITY_MAX_DEPTH && staticEval + Value(futilityMargin) <= alpha) {
+                    mp.skipQuiet();
+                    continue;
+                }
+                // History pruning
+                if (depth <= HISTORY_PRUNING_MAX_DEPTH &&
+                    historyScore < -HISTORY_PRUNING_MARGIN * depth) {
+                    continue;
+                }
+                // SEE pruning for quiet moves
+                if (depth <= SEE_PRUNING_MAX_DEPTH &&
+                    mp.seeValue(m) < -SEE_QUIET_MARGIN * depth) {
+                    continue;
+                }
+            } else if (depth <= SEE_PRUNING_MAX_DEPTH &&
+                       mp.seeValue(m) < -SEE_NOISY_MARGIN * depth * depth) {
+                // SEE pruning for captures
+                continue;
+            }
+        }
+
+        // Singular extension
+        // If the TT move is much better than all the other moves searched at
+        // a reduced depth, it is likely the only good move and is extended.
+        int extension = 0;
+        if (!isRoot && depth >= 8                                       // enough depth
+            && m.move() == ttMoveCode && !excludedMove.isValid()        // not already verifying
+            && ttType != EntryType::UPPER_BOUND && ttDepth >= depth - 3 // reliable lower bound
+            && ttValue.isValid() && !ttValue.isMate()                   //
+            && ply < 2 * rootDepth                                      // limit search explosion
+            && allowPruning                                             // not in strict mate search
+        ) {
+            const Value singularBeta  = ttValue - Value(2 * depth);
+            const int   singularDepth = (depth - 1) / 2;
+
+            currSS->excludedMove = m;
+            const Value singularScore =
+                negamax<false>(pos, singularDepth, ply, singularBeta - 1, singularBeta, cutnode);
+            currSS->excludedMove = Move::NO_MOVE;
+
+            if (singularScore < singularBeta) {
+                extension = 1; // TT move is singular
+            } else if (singularBeta >= beta) {
+                return singularBeta; // multi-cut: several moves beat beta
+            } else if (ttValue >= beta || cutnode) {
+                extension = -1; // other moves are good as well, TT move is less critical
+            }
+        }
+
         // todo reductions and prunings
         int reduction = 0;
 
         const int lmrMinDepth = isPV ? 4 : 3;
-        if (moveSearched >= 2 && depth >= lmrMinDepth && !inCheck) {
+        if (moveSearched >= 2 && depth >= lmrMinDepth && !inCheck && allowPruning) {
             reduction = LMRTable[depth][moveSearched];
             if (!cutnode) {
                 reduction--;
@@ -297,28 +716,29 @@ Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool c
             if (isPV) {
                 reduction--;
             }
-            if (!pos.isCapture(m) // reduce more for bad quiet moves
-                && searchHistory.qHistoryTable.get(pos.sideToMove(), m) < 0) {
-                reduction++;
+            if (isQuiet) { // reduce quiet moves by their history
+                if (historyScore < 0) {
+                    reduction++;
+                } else if (historyScore > MAX_HISTORY_SCORE) {
+                    reduction--;
+                }
             }
-            if (pos.isCapture(m) || pos.isCheckMove(m)) { // reduce less for tactic moves
+            // Reduce less for tactic moves
+            if (pos.isCapture(m) || pos.givesCheck(m, mp.getCheckInfo())) {
                 reduction--;
             }
         }
 
-        // Futility Pruning
-        if (!isPV && !isRoot && !inCheck && depth <= 8 && !pos.isCapture(m) &&
-            staticEval + Value(500) < alpha) {
-            mp.skipQuiet();
-            continue;
-        }
-
         // Principal variation search
         reduction       = std::clamp(reduction, 0, depth - 1);
-        int searchDepth = depth - reduction - 1;
+        int searchDepth = depth - reduction - 1 + extension;
+
+        currSS->move       = m;
+        currSS->movedPiece = pos.at(m.from());
 
-        Value score;
-        pos.makeMove(m);
+        Value         score;
+        PositionState undo;
+        pos.makeMove(m, undo);
         if (moveSearched == 1) {
             score = -negamax<isPV>(pos, searchDepth, ply + 1, -beta, -alpha, false);
         } else {
@@ -328,10 +748,10 @@ Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool c
                 score = -negamax<true>(pos, searchDepth, ply + 1, -beta, -alpha, false);
             }
         }
-        pos.unmakeMove(m);
+        pos.unmakeMove(undo);
 
         // Stop searching if time control is hit
-        if (g_timeControl.hitHardLimit(depth, searchStats.nodes) || g_stopRequested.load()) {
+        if (searchAborted(depth)) {
             return alpha;
         }
 
@@ -344,32 +764,223 @@ Value negamax(Position& pos, int depth, int ply, Value alpha, Value beta, bool c
             alpha            = score;
             ttFlag           = EntryType::EXACT;
             currSS->bestMove = m;
+            if (isPV) {
+                pvTable.update(ply, m);
+            }
             if (score >= beta) {
                 ttFlag = EntryType::LOWER_BOUND;
-                // Update quiet history
-                if (!pos.isCapture(bestMove)) {
-                    searchHistory.killerTable[ply].add(bestMove);
-                    searchHistory.qHistoryTable.update(pos.sideToMove(), bestMove, depth * depth);
-                } else {
-                    searchHistory.capHistoryTable.update(
-                        pos.sideToMove(), bestMove, pos, depth * depth);
-                }
+                updateCutoffHistories(
+                    pos,
+                    ply,
+                    depth,
+                    bestMove,
+                    quietsSearched,
+                    quietCount,
+                    capturesSearched,
+                    captureCount);
                 break;
             }
         }
+
+        if (!pos.isCapture(m)) {
+            if (quietCount < 64) {
+                quietsSearched[quietCount++] = m;
+            }
+        } else if (captureCount < 32) {
+            capturesSearched[captureCount++] = m;
+        }
     }
 
     if (moveSearched == 0) {
+        if (excludedMove.isValid()) {
+            return alpha; // the excluded move is the only legal move
+        }
         return inCheck ? Value::matedIn(ply) : DRAW_VALUE;
     }
 
-    if (!ttPruned) {
-        tt.store(pos, ttFlag, depth, bestMove, bestScore);
+    // Learn from the static evaluation error, unless the bound of the result
+    // says nothing about which way it was off. Captures are left out since
+    // their outcome is usually clear without the static evaluation.
+    if (!inCheck && !excludedMove.isValid() && !bestScore.isMate() &&
+        (!bestMove.isValid() || !pos.isCapture(bestMove)) &&
+        !(ttFlag == EntryType::LOWER_BOUND && bestScore <= staticEval) &&
+        !(ttFlag == EntryType::UPPER_BOUND && bestScore >= staticEval)) {
+        updateCorrectionHistory(pos, depth, bestScore, staticEval);
+    }
+
+    if (!ttPruned && !excludedMove.isValid()) {
+        tt.store(pos, ttFlag, depth, bestMove, bestScore, rawEval);
+    }
+
+    return bestScore;
+}
+
+/**
+ * Search the root position. Unlike `negamax`, the moves are taken from the
+ * root move list instead of `MovePicker`, and the statistics of every move
+ * are recorded for ordering the next iteration.
+ */
+Value searchRoot(
+    Position& pos, RootMoves& rootMoves, int depth, Value alpha, Value beta, bool verbose) {
+    const bool inCheck = pos.inCheck();
+    if (rootMoves.empty()) {
+        return inCheck ? Value::matedIn(0) : DRAW_VALUE;
+    }
+
+    SearchStackEntry* currSS = &searchStack[0];
+    currSS->inCheck          = inCheck;
+    pvTable.clear(0);
+
+    const CheckInfo checkInfo = pos.checkInfo();
+
+    searchHistory.killerTable[1].clear();
+    searchStats.nodes++;
+
+    Move      bestMove  = Move::NO_MOVE;
+    Value     bestScore = MATED_VALUE;
+    EntryType ttFlag    = EntryType::UPPER_BOUND;
+
+    for (size_t i = 0; i < rootMoves.size(); ++i) {
+        RootMove&  rm = rootMoves[i];
+        const Move m  = rm.move;
+
+        if (verbose && g_timeControl._elapsed() > CURRMOVE_REPORT_TIME) {
+            std::cout << "info depth " << depth << " currmove " << m << " currmovenumber "
+                      << i + 1 << std::endl;
+        }
+
+        // Late move reductions, same as in `negamax` for PV nodes
+        int reduction = 0;
+        if (i >= 1 && depth >= 4 && !inCheck && allowPruning) {
+            reduction = LMRTable[depth][i + 1] - 2;
+            if (pos.isCapture(m) || pos.givesCheck(m, checkInfo)) {
+                reduction--;
+            }
+        }
+        reduction = std::clamp(reduction, 0, depth - 1);
+
+        const uint64_t nodesBefore    = searchStats.nodes;
+        const int      selDepthBefore = searchStats.selDepth;
+        searchStats.selDepth          = 0;
+
+        currSS->move       = m;
+        currSS->movedPiece = pos.at(m.from());
+
+        // Principal variation search
+        Value         score;
+        PositionState undo;
+        pos.makeMove(m, undo);
+        if (i == 0) {
+            score = -negamax<true>(pos, depth - 1, 1, -beta, -alpha, false);
+        } else {
+            score = -negamax<false>(pos, depth - reduction - 1, 1, -alpha - 1, -alpha, true);
+            if (score > alpha && reduction > 0) {
+                score = -negamax<false>(pos, depth - 1, 1, -alpha - 1, -alpha, true);
+            }
+            if (score > alpha && score < beta) {
+                score = -negamax<true>(pos, depth - 1, 1, -beta, -alpha, false);
+            }
+        }
+        pos.unmakeMove(undo);
+
+        rm.nodes             = searchStats.nodes - nodesBefore;
+        rm.selDepth          = searchStats.selDepth;
+        searchStats.selDepth = std::max(selDepthBefore, searchStats.selDepth);
+
+        // Stop searching if time control is hit. The partial result is discarded.
+        if (searchAborted(depth)) {
+            return alpha;
+        }
+
+        // Only the moves raising alpha get an exact score, the others are
+        // merely known to be worse than the best move.
+        rm.previousScore = rm.score;
+        rm.score         = (i == 0 || score > alpha) ? score : MATED_VALUE;
+
+        if (score > bestScore) {
+            bestScore = score;
+        }
+        if (score > alpha) {
+            bestMove         = m;
+            alpha            = score;
+            ttFlag           = EntryType::EXACT;
+            currSS->bestMove = m;
+            pvTable.update(0, m);
+            rm.pv.assign(pvTable.moves[0], pvTable.moves[0] + pvTable.length[0]);
+            // In mate search the window starts right below the requested mate,
+            // so raising alpha means the mate is found. No need to look further.
+            if (score >= beta || g_timeControl.mateMoves > 0) {
+                ttFlag = EntryType::LOWER_BOUND;
+                break;
+            }
+        }
     }
 
+    tt.store(pos, ttFlag, depth, bestMove, bestScore);
+
     return bestScore;
 }
 
+/**
+ * Order the root moves for the next iteration. The best moves come first,
+ * and the moves that failed low are ordered by the effort spent on them.
+ */
+void sortRootMoves(RootMoves& rootMoves) {
+    std::stable_sort(rootMoves.begin(), rootMoves.end(), [](const RootMove& a, const RootMove& b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        return a.nodes > b.nodes;
+    });
+}
+
+/**
+ * Generate the root move list. If `go searchmoves` is given, only the listed
+ * moves are kept. The initial order is the one `MovePicker` would use.
+ */
+RootMoves generateRootMoves(Position& pos, const SearchParams& params) {
+    const TTEntry* ttEntry    = tt.probe(pos);
+    const uint16_t ttMoveCode = ttEntry ? ttEntry->move_code : 0;
+    const auto     begin      = params.searchMoves.begin();
+    const auto     end        = begin + params.numSearchMoves;
+
+    RootMoves  rootMoves;
+    MovePicker mp(pos, searchHistory, 0, ttMoveCode, false);
+    while (true) {
+        const Move m = mp.next();
+        if (m.move() == Move::NO_MOVE) {
+            break;
+        }
+        if (params.numSearchMoves > 0 && std::find(begin, end, m.move()) == end) {
+            continue;
+        }
+        rootMoves.emplace_back(m);
+    }
+    return rootMoves;
+}
+
+/**
+ * Get the expected reply to our best move, which is the move to ponder on.
+ * This is the second move of the PV, or the TT move of the position after
+ * the best move if the PV is too short.
+ */
+Move getPonderMove(Position& pos, const RootMoves& rootMoves, const Move bestMove) {
+    for (const RootMove& rm : rootMoves) {
+        if (rm.move == bestMove && rm.pv.size() >= 2) {
+            return rm.pv[1];
+        }
+    }
+    PositionState undo;
+    pos.makeMove(bestMove, undo);
+    const TTEntry* ttEntry    = tt.probe(pos);
+    Move           ponderMove = Move::NO_MOVE;
+    if (ttEntry && ttEntry->move_code != 0 && pos.isLegal(Move(ttEntry->move_code))) {
+        ponderMove = Move(ttEntry->move_code);
+    }
+    pos.unmakeMove(undo);
+    return ponderMove;
+}
+
 void searchWorker(
     SearchParams params,
     Position     pos,
@@ -379,19 +990,23 @@ void searchWorker(
     g_stopRequested.store(false);
     searchStack.fill(SearchStackEntry {});
     tt.incGeneration();
+    searchHistory.qHistoryTable.age();
     computeLMRTable();
+    allowPruning = !(params.mate > 0 && g_ucioption.isStrictMateSearch());
 
     g_timeControl = TimeControl(pos.sideToMove(), params, TimeControl::now());
     int maxDepth  = g_timeControl.getLoopDepth();
 
-    Move  rootBestMove;
-    Value rootBestScore = MATED_VALUE;
+    RootMoves rootMoves = generateRootMoves(pos, params);
+    Move      rootBestMove  = Move::NO_MOVE;
+    Value     rootBestScore = MATED_VALUE;
 
     Value windowUpper = 20;
     Value windowLower = 20;
 
     for (int depth = 1; depth <= maxDepth; ++depth) {
         searchStats = SearchStats();
+        rootDepth   = depth;
         if (g_stopRequested.load())
             break;
         if (verbose && g_timeControl.hitSoftLimit(depth, searchStats.nodes, 0)) {
@@ -402,9 +1017,8 @@ void searchWorker(
         // In competition mode, at depth 1 we check if there is only one legal move.
         // If so, we don't search any more.
         if (g_timeControl.competitionMode && depth == 1) {
-            Movelist legalMoves = pos.legalMoves();
-            if (legalMoves.size() == 1) {
-                rootBestMove  = legalMoves[0];
+            if (rootMoves.size() == 1) {
+                rootBestMove  = rootMoves[0].move;
                 rootBestScore = evaluate(pos); // static evaluation
                 if (verbose) {
                     std::cout << "info depth 1 score " << rootBestScore << " nodes 0 seldepth 0"
@@ -414,15 +1028,40 @@ void searchWorker(
             }
         }
 
-        // Aspiration window
-        Value score;
-        if (depth <= 3) {
-            score = negamax<true>(pos, depth, 0, MATED_VALUE, MATE_VALUE, false);
-        } else {
-            Value alpha = rootBestScore - windowLower;
-            Value beta  = rootBestScore + windowUpper;
-            score       = negamax<true>(pos, depth, 0, alpha, beta, false);
-            // Adjust window on fail-highs or fail-lows
+        // Aspiration window. In mate search only a mate within the requested
+        // number of moves is of interest, so the window starts right below it.
+        const bool  mateSearch = g_timeControl.mateMoves > 0;
+        const bool  useWindow  = !mateSearch && depth > 3;
+        const Value alpha      = mateSearch  ? Value::mateIn(2 * g_timeControl.mateMoves)
+                                 : useWindow ? rootBestScore - windowLower
+                                             : MATED_VALUE;
+        const Value beta       = useWindow ? rootBestScore + windowUpper : MATE_VALUE;
+        const Value score      = searchRoot(pos, rootMoves, depth, alpha, beta, verbose);
+        if (searchAborted(depth)) {
+            break; // the iteration is incomplete, keep the previous result
+        }
+        if (rootMoves.empty()) {
+            rootBestScore = score;
+            break; // checkmate or stalemate
+        }
+        sortRootMoves(rootMoves);
+
+        if (mateSearch && score <= alpha) {
+            // No mate found yet. Without pruning and reductions, a full-width
+            // search of 2N-1 plies proves there is no mate in N.
+            if (verbose) {
+                std::cout << "info depth " << depth << " seldepth " << searchStats.selDepth
+                          << " nodes " << searchStats.nodes << " time "
+                          << g_timeControl._elapsed() << std::endl;
+            }
+            if (!allowPruning && depth >= 2 * (int) g_timeControl.mateMoves - 1) {
+                break;
+            }
+            continue;
+        }
+
+        // Adjust window on fail-highs or fail-lows
+        if (useWindow) {
             if (score >= beta) {
                 windowUpper = std::min(MATE_VALUE, windowUpper * 2);
                 continue;
@@ -436,10 +1075,9 @@ void searchWorker(
             }
         }
 
-        auto pv = extractPv(pos, depth);
-        if (!pv.empty())
-            rootBestMove = pv.front();
+        rootBestMove  = rootMoves[0].move;
         rootBestScore = score;
+        const auto& pv = rootMoves[0].pv;
 
         const auto statNodesSearched = searchStats.nodes;
         const auto statTimeElapsed   = g_timeControl._elapsed();
@@ -455,17 +1093,36 @@ void searchWorker(
             std::cout << std::endl;
         }
 
+        if (mateSearch) // the requested mate is found
+            break;
         if (g_timeControl.hitSoftLimit(depth, (int) searchStats.nodes, 0))
             break;
         if (g_stopRequested.load())
             break;
     }
 
+    // Fall back to the first root move if no iteration has completed
+    if (rootBestMove.move() == 0 && !rootMoves.empty()) {
+        rootBestMove = rootMoves[0].move;
+    }
+
+    // The best move must not be sent while pondering, even if the search
+    // is finished. Wait for the GUI to send ponderhit or stop.
+    while (g_timeControl.pondering && !g_ponderHit.load() && !g_stopRequested.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
     if (verbose) {
-        if (rootBestMove.move() != 0)
-            std::cout << "bestmove " << rootBestMove << std::endl;
-        else
+        if (rootBestMove.move() != 0) {
+            std::cout << "bestmove " << rootBestMove;
+            const Move ponderMove = getPonderMove(pos, rootMoves, rootBestMove);
+            if (ponderMove.move() != Move::NO_MOVE) {
+                std::cout << " ponder " << ponderMove;
+            }
+            std::cout << std::endl;
+        } else {
             std::cout << "bestmove 0000" << std::endl;
+        }
     }
 
     if (outBestMove)
@@ -482,6 +1139,7 @@ void think(SearchParams params, const Position pos) {
         searchThread.join();
     }
     g_stopRequested.store(false);
+    g_ponderHit.store(false);
     searchStats = SearchStats();
     searchStack.fill(SearchStackEntry {});
     searchThread = std::thread(searchWorker, params, pos, nullptr, nullptr, true);
@@ -502,6 +1160,17 @@ std::pair<uint16_t, Value> internalSearch(SearchParams params, const Position po
     return {bestMove, bestValue};
 }
 
+/**
+ * Number of nodes visited by the last search.
+ */
+uint64_t lastSearchNodes() {
+    return searchStats.nodes;
+}
+
+void ponderHit() {
+    g_ponderHit.store(true);
+}
+
 void stopThinking() {
     g_stopRequested.store(true);
     if (searchThread.joinable())
@@ -5,9 +5,12 @@
 #include <atomic>
 
 extern std::atomic<bool> g_stopRequested;
+extern std::atomic<bool> g_ponderHit;
 extern TimeControl       g_timeControl;
 
 void think(SearchParams params, const Position pos);
 void stopThinking();
+void ponderHit();
 
 std::pair<uint16_t, Value> internalSearch(SearchParams params, const Position pos);
+uint64_t                   lastSearchNodes();
@@ -14,19 +14,29 @@ using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
  * at the beginning of an iteration. The idea is that if the engine isn't likely
  * to finish the iteration in time, it should stop the search immediately to
  * save time.
+ *
+ * While pondering, neither limit applies until the opponent plays the expected
+ * move. The limits are then measured from the moment of the ponderhit, while
+ * the reported search time still counts from the start of the search.
  */
 struct TimeControl {
     uint32_t  softTimeWall = 0;
     uint32_t  hardTimeWall = 0;
     uint32_t  maxDepth     = 0;
     uint32_t  nodesWall    = 0;
-    TimePoint startTime;
+    TimePoint startTime; // start of the search, for reporting
+    TimePoint limitTime; // start of our clock, for the limits
     bool      competitionMode = false;
+    bool      pondering       = false;
+    uint32_t  mateMoves       = 0; // search for a mate in this many moves, see `go mate`
 
     TimeControl() = default;
     TimeControl(const Color stm, const SearchParams& params, TimePoint now) {
         uint32_t time, inc;
         startTime = now;
+        limitTime = now;
+        pondering = params.ponder;
+        mateMoves = params.mate;
 
         if (params.movetime > 0) { // specify move time
             softTimeWall = hardTimeWall = params.movetime;
@@ -38,7 +48,7 @@ struct TimeControl {
             nodesWall    = params.nodes;
             softTimeWall = hardTimeWall = 10000000;
             return;
-        } else if (params.infinite) {
+        } else if (params.infinite || params.mate > 0) {
             maxDepth = 128;
             return;
         } else { // specify remaining time and increment
@@ -57,23 +67,44 @@ struct TimeControl {
         return steady_clock::now();
     }
 
+    /**
+     * Switch from pondering to normal time control. Our clock only starts
+     * running now, so the limits are measured from this point.
+     */
+    void ponderhit(TimePoint now) {
+        pondering = false;
+        limitTime = now;
+    }
+
     int _elapsed() const {
         using namespace std::chrono;
         TimePoint now = TimeControl::now();
         return duration_cast<milliseconds>(now - startTime).count();
     }
 
+    /**
+     * Time used on our clock, i.e. since the ponderhit when pondering.
+     */
+    int elapsedOnClock() const {
+        using namespace std::chrono;
+        TimePoint now = TimeControl::now();
+        return duration_cast<milliseconds>(now - limitTime).count();
+    }
+
     /**
      * Check if we have hit the hard time limit.
      */
     bool hitHardLimit(int depth, uint32_t nodes) const {
+        if (pondering) {
+            return false;
+        }
         if (nodesWall > 0 && nodes >= nodesWall * 3 / 2) {
             return true;
         }
         if (maxDepth > 0) {
             return depth > (int) maxDepth;
         }
-        return (uint32_t) _elapsed() >= hardTimeWall;
+        return (uint32_t) elapsedOnClock() >= hardTimeWall;
     }
 
     /**
@@ -82,6 +113,9 @@ struct TimeControl {
      * the evaluation is stable.
      */
     bool hitSoftLimit(int depth, uint32_t nodes, int stability) const {
+        if (pondering) {
+            return false;
+        }
         if (nodesWall > 0 && nodes >= nodesWall) {
             return true;
         }
@@ -95,7 +129,7 @@ struct TimeControl {
         }
         uint32_t limit = (uint32_t) (softTimeWall * scaleFactor);
 
-        return _elapsed() >= limit;
+        return elapsedOnClock() >= limit;
     }
 
     int getLoopDepth() const {
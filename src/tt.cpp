@@ -3,7 +3,7 @@
 TranspositionTable tt; // real definition here
 
 void TranspositionTable::store(
-    const Position& pos, EntryType type, int8_t depth, Move move, Value value) {
+    const Position& pos, EntryType type, int8_t depth, Move move, Value value, Value eval) {
     uint64_t key   = pos.hash();
     uint32_t index = key % size;
     bool     ok    = false;
@@ -24,6 +24,9 @@ void TranspositionTable::store(
         if (move.move() == Move::NO_MOVE) {
             move = db[index].move();
         }
+        if (!eval.isValid()) {
+            eval = db[index].eval;
+        }
     } else if (db[index].age != (generation & 0xff)) { // old entry
         ok = true;
     } else if (db[index].depth < depth) { // deeper entry
@@ -31,7 +34,7 @@ void TranspositionTable::store(
     }
 
     if (ok) {
-        db[index] = TTEntry(pos, type, depth, move, value);
+        db[index] = TTEntry(pos, type, depth, move, value, eval);
     }
 }
 
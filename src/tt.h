@@ -22,15 +22,24 @@ struct TTEntry {
     EntryType type;      // Entry type
     uint16_t  move_code; // Best move cached
     Value     value;     // Evaluation value
+    Value     eval;      // Raw static evaluation, VALUE_NONE if not computed
 
-    TTEntry() : zobrist(0ull), depth(0), age(0), type(EntryType::NONE), move_code(0), value(0) {}
-    TTEntry(const Position& pos, EntryType type, int8_t depth, Move move, Value value) :
+    TTEntry() :
+        zobrist(0ull),
+        depth(0),
+        age(0),
+        type(EntryType::NONE),
+        move_code(0),
+        value(0),
+        eval(VALUE_NONE) {}
+    TTEntry(const Position& pos, EntryType type, int8_t depth, Move move, Value value, Value eval) :
         zobrist(pos.hash()),
         depth(depth),
         age(0),
         type(type),
         move_code(move.move()),
-        value(value) {};
+        value(value),
+        eval(eval) {};
 
     /**
      * Get the move associated with this entry.
@@ -51,6 +60,7 @@ public:
     TranspositionTable() : size(0), occupied(0), generation(0) { db = nullptr; }
     ~TranspositionTable() { delete[] db; }
     inline void init(uint32_t size) {
+        delete[] db;
         this->size = size;
         db         = new TTEntry[size];
         clear();
@@ -59,11 +69,18 @@ public:
         for (uint32_t i = 0; i < size; i++) {
             db[i] = TTEntry();
         }
+        occupied   = 0;
+        generation = 0;
     }
     inline void incGeneration() { generation++; }
     inline int  hashfull() { return occupied * 1000 / size; }
 
-    void     store(const Position& pos, EntryType type, int8_t depth, Move move, Value value);
+    void     store(const Position& pos,
+                   EntryType       type,
+                   int8_t          depth,
+                   Move            move,
+                   Value           value,
+                   Value           eval = VALUE_NONE);
     TTEntry* probe(const Position& pos);
     std::pair<bool, Value>
     lookupEval(const Position& pos, int8_t depth, int8_t plyFromRoot, Value alpha, Value beta);
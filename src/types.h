@@ -1,6 +1,7 @@
 #pragma once
 
 #include "chess.hpp"
+#include <array>
 #include <chrono>
 
 #define WHITE chess::Color::WHITE
@@ -137,4 +138,9 @@ struct SearchParams {
     uint32_t nodes     = 0;
     uint32_t mate      = 0;
     uint32_t movetime  = 0;
+
+    // Root moves to restrict the search to, as given by `go searchmoves`.
+    // Empty if all legal moves should be searched.
+    std::array<uint16_t, chess::constants::MAX_MOVES> searchMoves    = {};
+    int                                               numSearchMoves = 0;
 };
@@ -1,6 +1,8 @@
 #include "uci.h"
 #include "chess.hpp"
+#include "bench.h"
 #include "eval.h"
+#include "perft.h"
 #include "search.h"
 #include <queue>
 #include <thread>
@@ -14,6 +16,18 @@ Position board;
 
 std::queue<std::thread> threads;
 
+/**
+ * Checks if a token looks like a move in long algebraic notation, e.g. "e2e4"
+ * or "e7e8q". Used to tell moves apart from keywords in "go searchmoves".
+ */
+bool isMoveToken(const std::string& token) {
+    if (token.size() != 4 && token.size() != 5) {
+        return false;
+    }
+    return token[0] >= 'a' && token[0] <= 'h' && token[1] >= '1' && token[1] <= '8' &&
+           token[2] >= 'a' && token[2] <= 'h' && token[3] >= '1' && token[3] <= '8';
+}
+
 /**
  * Executes a UCI command line.
  *
@@ -30,6 +44,8 @@ void execute(const std::string& command) {
         std::cout << "id author UndefinedCpp" << std::endl;
         std::cout << std::endl;
         std::cout << g_ucioption << std::endl;
+        std::cout << "info string sliding attacks use "
+                  << (chess::attacks::usesPext() ? "pext" : "magics") << std::endl;
         std::cout << "uciok" << std::endl;
         return;
     }
@@ -63,6 +79,16 @@ void execute(const std::string& command) {
         return;
     }
 
+    // <Command> bench [depth] [threads] [hash]
+    // Not part of UCI; searches the bench positions, see bench.cpp
+    if (token == "bench") {
+        int depth = BENCH_DEPTH, threads = 1, hash = 16;
+        iss >> depth >> threads >> hash;
+        stopThinking();
+        bench_main(depth, threads, hash);
+        return;
+    }
+
     // <Command> ucinewgame
     if (token == "ucinewgame") {
         return;
@@ -111,7 +137,13 @@ void execute(const std::string& command) {
         // Parse "go" options
         SearchParams params;
         while (iss >> token) {
-            if (token == "infinite") {
+            if (token == "perft") {
+                // Count the moves below each root move instead of searching
+                int depth = 1;
+                iss >> depth;
+                perft_divide(uci::board, depth, std::thread::hardware_concurrency(), 16);
+                return;
+            } else if (token == "infinite") {
                 params.infinite = true;
             } else if (token == "wtime") {
                 iss >> params.wtime;
@@ -133,6 +165,18 @@ void execute(const std::string& command) {
                 iss >> params.movetime;
             } else if (token == "ponder") {
                 params.ponder = true;
+            } else if (token == "searchmoves") {
+                // Moves are listed until the next keyword or the end of line
+                std::streampos last = iss.tellg();
+                while (iss >> token && isMoveToken(token)) {
+                    Move move = chess::uci::uciToMove(uci::board, token);
+                    if (params.numSearchMoves < (int) params.searchMoves.size()) {
+                        params.searchMoves[params.numSearchMoves++] = move.move();
+                    }
+                    last = iss.tellg();
+                }
+                iss.clear();
+                iss.seekg(last);
             } else {
                 break; // stop on unknown token
             }
@@ -146,10 +190,14 @@ void execute(const std::string& command) {
     // <Command> stop
     if (token == "stop") {
         stopThinking();
+        return;
     }
 
     // <Command> ponderhit
+    // The opponent played the expected move, so the ongoing search continues
+    // with normal time control.
     if (token == "ponderhit") {
+        ponderHit();
         return;
     }
 
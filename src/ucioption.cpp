@@ -11,10 +11,17 @@ void UCIOption::set(const std::string& name, const std::string& value) {
             hash.value = parsedValue;
             tt.init(parsedValue * 1024 * 1024 / sizeof(TTEntry));
         }
+    } else if (name == "Ponder") {
+        // Only tells us whether the GUI may send "go ponder"; nothing to set up
+        ponder = value == "true";
+    } else if (name == "StrictMateSearch") {
+        strictMateSearch = value == "true";
     }
 }
 
 std::ostream& operator<<(std::ostream& os, const UCIOption& option) {
     os << "option name Hash type spin default 16 min 1 max 2048" << std::endl;
+    os << "option name Ponder type check default false" << std::endl;
+    os << "option name StrictMateSearch type check default true" << std::endl;
     return os;
 }
\ No newline at end of file
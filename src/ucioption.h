@@ -11,6 +11,10 @@ public:
 
     void set(const std::string& name, const std::string& value);
 
+    bool isStrictMateSearch() const { return strictMateSearch; }
+
+    int hashSize() const { return hash.value; }
+
 private:
     struct Numeric {
         int value;
@@ -19,7 +23,12 @@ private:
         Numeric(int value, int min, int max) : value(value), min(min), max(max) {}
     };
 
-    Numeric hash = Numeric(16, 1, 2048);
+    Numeric hash   = Numeric(16, 1, 2048);
+    bool    ponder = false;
+
+    // Disable pruning and reductions in `go mate`, so that not finding a mate
+    // is a proof that there is none
+    bool strictMateSearch = true;
 };
 
 std::ostream& operator<<(std::ostream& os, const UCIOption& option);